@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// replaces the global operator new and delete with versions that count
+// allocations. include this from exactly one source file of a benchmark.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#  include <malloc.h>
+#endif
+
+namespace allocation_counter {
+inline std::atomic<std::size_t> allocations{0};
+
+// allocations made by any thread since the process started
+inline std::size_t count() noexcept {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+inline void* allocate(std::size_t size, std::size_t alignment) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  size = size == 0 ? 1 : size;
+#if defined(_WIN32)
+  void* p = _aligned_malloc(size, alignment);
+#else
+  // aligned_alloc wants a multiple of the alignment
+  void* p = alignment <= alignof(std::max_align_t)
+      ? std::malloc(size)
+      : std::aligned_alloc(
+            alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+  if (!p) {
+    throw std::bad_alloc{};
+  }
+  return p;
+}
+inline void free(void* p) noexcept {
+#if defined(_WIN32)
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+}  // namespace allocation_counter
+
+void* operator new(std::size_t size) {
+  return allocation_counter::allocate(size, alignof(std::max_align_t));
+}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return allocation_counter::allocate(
+      size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* p) noexcept {
+  allocation_counter::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+  allocation_counter::free(p);
+}
+void operator delete(void* p, std::align_val_t) noexcept {
+  allocation_counter::free(p);
+}
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+  allocation_counter::free(p);
+}
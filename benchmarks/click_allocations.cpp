@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/sync_wait.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "allocation_counter.hpp"
+#include "com_thread.hpp"
+#include "key_event.hpp"
+#include "player.hpp"
+
+// proves that clicks do not allocate once the player is running
+int main() {
+  using namespace std::literals::chrono_literals;
+
+  com_thread com{5ms};
+  Player player{
+      com.get_scheduler(), com.get_scheduler(com_thread::priority::high)};
+  unifex::sync_wait(player.start());
+
+  // bursts stay below the spawn pool capacity, so nothing is dropped
+  auto type = [&](int keys) {
+    for (int i = 0; i < keys; ++i) {
+      player.Click(key_event{0x0100, std::uint32_t('A' + i % 26)});
+    }
+    while (player.spawns_in_flight() > 0) {
+      std::this_thread::yield();
+    }
+  };
+
+  // first use of each path may allocate
+  type(Player::spawnCapacity / 2);
+
+  constexpr int bursts = 1000;
+  auto before = allocation_counter::count();
+  for (int i = 0; i < bursts; ++i) {
+    type(Player::spawnCapacity / 2);
+  }
+  auto during = allocation_counter::count() - before;
+
+  auto dropped = player.dropped_clicks();
+  unifex::sync_wait(player.destroy());
+
+  printf(
+      "%d clicks: %zu allocations, %zu dropped\n",
+      bursts * int(Player::spawnCapacity / 2),
+      during,
+      dropped);
+  return during == 0 && dropped == 0 ? 0 : 1;
+}
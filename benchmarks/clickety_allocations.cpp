@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/done_as_optional.hpp>
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/task.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#include "allocation_counter.hpp"
+#include "key_event.hpp"
+#include "manual_event_source.hpp"
+#include "sender_range.hpp"
+
+namespace {
+// the same loop as clickety, counting instead of clicking
+template <typename Range>
+unifex::task<void> consume(Range& range, std::atomic<std::size_t>& count) {
+  for (auto next : range.view()) {
+    auto event = co_await unifex::done_as_optional(std::move(next));
+    if (!event) {
+      break;
+    }
+    count.fetch_add(1, std::memory_order_release);
+  }
+  co_return;
+}
+}  // namespace
+
+// proves that awaiting one event per iteration in a task does not allocate.
+// the frame of the task itself is allocated once, before the events flow.
+int main() {
+  constexpr std::size_t warmup = 1000;
+  constexpr std::size_t events = 1000000;
+
+  manual_event_source<key_event> source;
+  unifex::inplace_stop_source stop;
+  auto range = create_buffered_event_sender_range<key_event, 64>(
+      stop.get_token(),
+      overflow_policy::block,
+      source.register_fn(),
+      source.unregister_fn());
+
+  std::size_t perEvent = 0;
+  std::atomic<std::size_t> consumed{0};
+  std::thread producer{[&]() {
+    auto send = [&](std::size_t count) {
+      auto target = consumed.load() + count;
+      for (std::size_t i = 0; i < count; ++i) {
+        source.emit(key_event{0x0100, std::uint32_t('A' + i % 26)});
+      }
+      while (consumed.load(std::memory_order_acquire) < target) {
+        std::this_thread::yield();
+      }
+    };
+    send(warmup);
+    auto before = allocation_counter::count();
+    send(events);
+    perEvent = allocation_counter::count() - before;
+    stop.request_stop();
+  }};
+
+  unifex::sync_wait(consume(range, consumed));
+  producer.join();
+
+  printf("%zu events: %zu allocations\n", events, perEvent);
+  return perEvent == 0 ? 0 : 1;
+}
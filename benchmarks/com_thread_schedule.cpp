@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/scheduler_concepts.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/then.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#include "com_thread.hpp"
+#include "latency_recorder.hpp"
+#include "spawn_pool.hpp"
+
+// time from schedule() on another thread to the task running on the com
+// thread, with the queue idle and with normal priority work queued
+int main() {
+  using namespace std::literals::chrono_literals;
+  using clock_t = std::chrono::steady_clock;
+
+  constexpr int iterations = 20000;
+  constexpr int backlog = 32;
+
+  com_thread com{5ms};
+  spawn_pool<backlog> background;
+
+  auto measure = [&](latency_recorder& recorder, com_thread::priority p) {
+    auto start = clock_t::now();
+    unifex::sync_wait(
+        unifex::then(unifex::schedule(com.get_scheduler(p)), [&]() noexcept {
+          recorder.record(clock_t::now() - start);
+        }));
+  };
+
+  latency_recorder idle{"com_thread schedule to run, idle", iterations};
+  for (int i = 0; i < iterations; ++i) {
+    measure(idle, com_thread::priority::normal);
+  }
+
+  latency_recorder loaded{
+      "com_thread schedule to run, high over 32 normal", iterations};
+  for (int i = 0; i < iterations; ++i) {
+    for (int j = 0; j < backlog; ++j) {
+      (void)background.spawn_call_on(
+          com.get_scheduler(com_thread::priority::normal), []() noexcept {
+            auto until = clock_t::now() + 2us;
+            while (clock_t::now() < until) {
+            }
+          });
+    }
+    measure(loaded, com_thread::priority::high);
+    while (background.in_use() > 0) {
+      std::this_thread::yield();
+    }
+  }
+  unifex::sync_wait(background.complete());
+
+  idle.report();
+  loaded.report();
+
+  auto stats = com.snapshot();
+  printf(
+      "%-44s %.1f tasks per drain (max %llu), %llu wakes posted, "
+      "%llu coalesced, max delay %.3fus\n",
+      "com_thread counters",
+      stats.tasks_per_drain(),
+      static_cast<unsigned long long>(stats.maxTasksPerDrain_),
+      static_cast<unsigned long long>(stats.wakesPosted_),
+      static_cast<unsigned long long>(stats.wakesCoalesced_),
+      std::chrono::duration<double, std::micro>(stats.maxScheduleDelay_)
+          .count());
+  // every task scheduled above has run
+  return stats.queueDepth_ == 0 &&
+          stats.tasksRun_ >= std::uint64_t(iterations) * (backlog + 2)
+      ? 0
+      : 1;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/scheduler_concepts.hpp>
+#include <unifex/sync_wait.hpp>
+
+#include <chrono>
+
+#include "com_thread.hpp"
+#include "latency_recorder.hpp"
+
+// measures constructing a com_thread, running one task on it and joining it
+int main() {
+  using namespace std::literals::chrono_literals;
+  using clock_t = std::chrono::steady_clock;
+
+  constexpr int iterations = 100;
+  latency_recorder startToExit{"com_thread start to exit", iterations};
+
+  for (int i = 0; i < iterations; ++i) {
+    auto start = clock_t::now();
+    {
+      com_thread com{50ms};
+      unifex::sync_wait(unifex::schedule(com.get_scheduler()));
+    }
+    startToExit.record(clock_t::now() - start);
+  }
+
+  startToExit.report();
+
+  // join used to sleep for 500ms
+  return startToExit.percentile(0.99) < 100ms ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/scheduler_concepts.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/then.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "com_thread.hpp"
+#include "latency_recorder.hpp"
+#include "watchdog.hpp"
+
+namespace {
+using steady_clock = std::chrono::steady_clock;
+
+struct observed {
+  // written last, so the other fields are visible once it changes
+  std::atomic<int> stalls_{0};
+  const char* label_{nullptr};
+  steady_clock::time_point reported_{};
+};
+
+void observe(void* context, const com_thread_stall& stall) noexcept {
+  auto& o = *static_cast<observed*>(context);
+  o.label_ = stall.label_;
+  o.reported_ = steady_clock::now();
+  o.stalls_.fetch_add(1, std::memory_order_release);
+}
+}  // namespace
+
+// blocks the com thread for longer than the deadline and measures how long
+// the watchdog takes to notice, after a run of short tasks that must not be
+// reported
+int main() {
+  using namespace std::literals::chrono_literals;
+
+  constexpr auto deadline = 20ms;
+  constexpr int iterations = 10;
+
+  com_thread com{5ms};
+  observed o;
+  com_thread_watchdog watchdog{com, deadline, &observe, &o};
+  auto scheduler = com.get_scheduler();
+
+  for (int i = 0; i < 1000; ++i) {
+    unifex::sync_wait(unifex::schedule(scheduler.with_label("short task")));
+  }
+  int failures = o.stalls_.load() == 0 ? 0 : 1;
+
+  latency_recorder detection{"com_thread stall past deadline", iterations};
+  for (int i = 0; i < iterations; ++i) {
+    auto before = o.stalls_.load(std::memory_order_acquire);
+    steady_clock::time_point start;
+    unifex::sync_wait(unifex::then(
+        unifex::schedule(scheduler.with_label("blocking task")),
+        [&]() noexcept {
+          start = steady_clock::now();
+          std::this_thread::sleep_for(deadline * 3);
+        }));
+    // the watchdog runs on its own thread and reports while the task is
+    // blocked
+    if (o.stalls_.load(std::memory_order_acquire) != before + 1 ||
+        std::strcmp(o.label_, "blocking task") != 0) {
+      ++failures;
+      continue;
+    }
+    detection.record(o.reported_ - start - deadline);
+  }
+
+  detection.report();
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/done_as_optional.hpp>
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/task.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <span>
+#include <thread>
+
+#include "com_thread.hpp"
+#include "latency_recorder.hpp"
+#include "manual_event_source.hpp"
+#include "mixer.hpp"
+#include "sample_source.hpp"
+#include "sender_range.hpp"
+#include "spawn_pool.hpp"
+
+namespace {
+using steady_clock = std::chrono::steady_clock;
+
+struct stamped_event {
+  steady_clock::time_point sent_{};
+};
+
+// clickety and Player::Click, with the trigger time recorded
+template <typename Range, typename Scheduler, typename Pool, typename Mixer>
+unifex::task<void> clickety(
+    Range& range,
+    Scheduler clickLoop,
+    Pool& spawns,
+    Mixer& mixer,
+    std::span<const float> click,
+    latency_recorder& latency,
+    std::atomic<std::size_t>& triggered) {
+  for (auto next : range.view()) {
+    auto event = co_await unifex::done_as_optional(std::move(next));
+    if (!event) {
+      break;
+    }
+    (void)spawns.spawn_call_on(clickLoop, [&, sent = event->sent_]() noexcept {
+      mixer.trigger(click);
+      latency.record(steady_clock::now() - sent);
+      triggered.fetch_add(1, std::memory_order_release);
+    });
+  }
+  co_return;
+}
+}  // namespace
+
+// from a synthetic key event on a producer thread, through sender_range,
+// the consumer coroutine and the com thread, to the mixer trigger
+int main() {
+  using namespace std::literals::chrono_literals;
+
+  constexpr std::size_t events = 20000;
+
+  com_thread com{com_thread::adaptive_slice{1ms, 10ms, 2ms}};
+  spawn_pool<64> spawns;
+  mixer<32> mix;
+  auto click = synthesize_click(48000);
+
+  manual_event_source<stamped_event> source;
+  unifex::inplace_stop_source stop;
+  auto range = create_buffered_event_sender_range<stamped_event, 64>(
+      stop.get_token(),
+      overflow_policy::block,
+      source.register_fn(),
+      source.unregister_fn());
+
+  latency_recorder latency{"synthetic event to mixer trigger", events};
+  std::atomic<std::size_t> triggered{0};
+
+  std::thread producer{[&]() {
+    for (std::size_t i = 0; i < events; ++i) {
+      source.emit(stamped_event{steady_clock::now()});
+      while (triggered.load(std::memory_order_acquire) <= i) {
+        std::this_thread::yield();
+      }
+    }
+    stop.request_stop();
+  }};
+  // the audio thread is not running, so keep the trigger ring from filling
+  std::atomic<bool> done{false};
+  std::thread audio{[&]() {
+    std::array<float, 256> block;
+    while (!done.load(std::memory_order_acquire)) {
+      mix.render(block);
+      std::this_thread::sleep_for(1ms);
+    }
+  }};
+
+  unifex::sync_wait(clickety(
+      range,
+      com.get_scheduler(com_thread::priority::high),
+      spawns,
+      mix,
+      click,
+      latency,
+      triggered));
+  producer.join();
+  unifex::sync_wait(spawns.complete());
+  done.store(true, std::memory_order_release);
+  audio.join();
+
+  latency.report();
+  return 0;
+}
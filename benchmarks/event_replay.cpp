@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/done_as_optional.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/task.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+
+#include "event_log.hpp"
+#include "key_event.hpp"
+
+namespace {
+using steady_clock = std::chrono::steady_clock;
+
+unifex::task<void> consume(
+    replay_event_source<key_event>& source,
+    std::atomic<std::uint64_t>& received) {
+  for (auto next : source.batches()) {
+    auto batch = co_await unifex::done_as_optional(std::move(next));
+    if (!batch) {
+      break;
+    }
+    received.fetch_add(batch->size(), std::memory_order_release);
+  }
+  co_return;
+}
+
+// replays the log and returns the seconds it took, or a negative value when
+// events went missing
+double replay(const std::filesystem::path& path, replay_timing timing) {
+  using namespace std::literals::chrono_literals;
+
+  replay_event_source<key_event> source{path, timing};
+  std::atomic<std::uint64_t> received{0};
+
+  auto start = steady_clock::now();
+  std::thread stopper{[&]() {
+    while (!source.finished() ||
+           received.load(std::memory_order_acquire) < source.size()) {
+      std::this_thread::sleep_for(1ms);
+    }
+    unifex::sync_wait(source.destroy());
+    source.request_stop();
+  }};
+  unifex::sync_wait(source.start());
+  unifex::sync_wait(consume(source, received));
+  stopper.join();
+  auto elapsed = std::chrono::duration<double>(steady_clock::now() - start);
+
+  return received.load() == source.size() ? elapsed.count() : -1.0;
+}
+}  // namespace
+
+// records keystrokes 100us apart to a log, then replays it at the original
+// timing and as fast as possible
+int main() {
+  using namespace std::literals::chrono_literals;
+
+  constexpr std::uint64_t events = 5000;
+  auto path = std::filesystem::temp_directory_path() / "kbrdhook-replay.kbel";
+
+  auto start = steady_clock::now();
+  {
+    event_log_writer<key_event> log{path, events};
+    for (std::uint64_t i = 0; i < events; ++i) {
+      auto due = start + i * 100us;
+      while (steady_clock::now() < due) {
+      }
+      log.append(key_event{0x0100, std::uint32_t(0x41 + i % 26)});
+    }
+  }
+  auto recorded = std::chrono::duration<double>(steady_clock::now() - start);
+
+  auto original = replay(path, replay_timing::original);
+  auto fastest = replay(path, replay_timing::as_fast_as_possible);
+  std::filesystem::remove(path);
+
+  printf(
+      "%-44s %llu events over %.3fs\n",
+      "recorded",
+      static_cast<unsigned long long>(events),
+      recorded.count());
+  printf("%-44s %.3fs\n", "replay at original timing", original);
+  printf(
+      "%-44s %.3fs, %.0f events/s\n",
+      "replay as fast as possible",
+      fastest,
+      events / fastest);
+
+  // every event arrives, and the original timing is kept to within 10%
+  return original > 0 && fastest > 0 &&
+          original > recorded.count() * 0.9 &&
+          original < recorded.count() * 1.1
+      ? 0
+      : 1;
+}
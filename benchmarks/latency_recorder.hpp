@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+// collects one sample per iteration and reports percentiles
+class latency_recorder {
+  const char* name_;
+  std::vector<std::chrono::nanoseconds> samples_;
+  bool sorted_ = false;
+
+public:
+  explicit latency_recorder(const char* name, std::size_t expected = 0)
+    : name_(name) {
+    samples_.reserve(expected);
+  }
+
+  void record(std::chrono::nanoseconds sample) {
+    samples_.push_back(sample);
+    sorted_ = false;
+  }
+
+  std::size_t size() const noexcept { return samples_.size(); }
+
+  // p in [0, 1]
+  std::chrono::nanoseconds percentile(double p) {
+    if (samples_.empty()) {
+      return std::chrono::nanoseconds{0};
+    }
+    if (!sorted_) {
+      std::sort(samples_.begin(), samples_.end());
+      sorted_ = true;
+    }
+    auto index = static_cast<std::size_t>(p * (samples_.size() - 1) + 0.5);
+    return samples_[index];
+  }
+
+  void report() {
+    auto us = [](std::chrono::nanoseconds d) {
+      return std::chrono::duration<double, std::micro>(d).count();
+    };
+    printf(
+        "%-44s n=%-8zu p50=%10.3fus p99=%10.3fus p999=%10.3fus "
+        "max=%10.3fus\n",
+        name_,
+        samples_.size(),
+        us(percentile(0.5)),
+        us(percentile(0.99)),
+        us(percentile(0.999)),
+        us(percentile(1.0)));
+    fflush(stdout);
+  }
+};
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <type_traits>
+
+// the register and unregister functions for a sender_range whose events are
+// pushed by the benchmark instead of the keyboard hook
+template <typename EventType>
+struct manual_event_source {
+  void* target_{nullptr};
+  void (*emit_)(void*, EventType&){nullptr};
+
+  // deliver one event on the calling thread
+  void emit(EventType event) { emit_(target_, event); }
+
+  auto register_fn() {
+    return [this](auto& fn) noexcept {
+      target_ = &fn;
+      emit_ = [](void* target, EventType& event) {
+        (*static_cast<std::remove_reference_t<decltype(fn)>*>(target))(event);
+      };
+      return 0;
+    };
+  }
+  static auto unregister_fn() {
+    return [](int&) noexcept {};
+  }
+};
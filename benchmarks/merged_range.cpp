@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/done_as_optional.hpp>
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/task.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <thread>
+#include <variant>
+
+#include "latency_recorder.hpp"
+#include "manual_event_source.hpp"
+#include "merged_range.hpp"
+#include "sender_range.hpp"
+
+namespace {
+using steady_clock = std::chrono::steady_clock;
+
+struct stamped_event {
+  steady_clock::time_point sent_{};
+};
+
+template <typename Range>
+unifex::task<void> consume(
+    Range& range,
+    latency_recorder& latency,
+    std::atomic<std::size_t>& consumed) {
+  for (auto next : range) {
+    auto event = co_await unifex::done_as_optional(std::move(next));
+    if (!event) {
+      break;
+    }
+    auto& e = std::visit(
+        [](auto& e) -> const stamped_event& { return e; }, *event);
+    latency.record(steady_clock::now() - e.sent_);
+    consumed.fetch_add(1, std::memory_order_release);
+  }
+  co_return;
+}
+}  // namespace
+
+// three producer threads flood their own sender_range, one consumer takes
+// the events from all three through merge()
+int main() {
+  constexpr std::size_t events = 100000;
+  constexpr std::size_t sources = 3;
+
+  std::array<manual_event_source<stamped_event>, sources> source;
+  unifex::inplace_stop_source stop;
+  auto make = [&](std::size_t i) {
+    return create_buffered_event_sender_range<stamped_event, 1024>(
+        stop.get_token(),
+        overflow_policy::block,
+        source[i].register_fn(),
+        source[i].unregister_fn());
+  };
+  auto range0 = make(0);
+  auto range1 = make(1);
+  auto range2 = make(2);
+  auto merged = merge(range0.view(), range1.view(), range2.view());
+
+  latency_recorder latency{
+      "merge of 3 sender_ranges, flooded", sources * events};
+  std::atomic<std::size_t> consumed{0};
+
+  auto start = steady_clock::now();
+  std::array<std::thread, sources> producers;
+  for (std::size_t i = 0; i < sources; ++i) {
+    producers[i] = std::thread{[&, i]() {
+      for (std::size_t n = 0; n < events; ++n) {
+        source[i].emit(stamped_event{steady_clock::now()});
+      }
+    }};
+  }
+  std::thread stopper{[&]() {
+    for (auto& p : producers) {
+      p.join();
+    }
+    // block means no event is dropped
+    while (consumed.load(std::memory_order_acquire) < sources * events) {
+      std::this_thread::yield();
+    }
+    stop.request_stop();
+  }};
+
+  unifex::sync_wait(consume(merged, latency, consumed));
+  stopper.join();
+  auto elapsed = steady_clock::now() - start;
+
+  latency.report();
+  printf(
+      "%-44s %.0f events/s\n",
+      "merge throughput",
+      sources * events / std::chrono::duration<double>(elapsed).count());
+  return 0;
+}
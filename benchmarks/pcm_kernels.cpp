@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "latency_recorder.hpp"
+#include "pcm_kernels.hpp"
+
+// times the simd mixing kernels against the scalar path for one block of
+// output at 1, 8 and 64 voices. tests/pcm_kernels.cpp checks that they
+// agree.
+int main() {
+  using clock_t = std::chrono::steady_clock;
+
+  constexpr std::size_t frames = 256;
+  constexpr int iterations = 20000;
+  constexpr std::size_t voiceCounts[] = {1, 8, 64};
+  constexpr std::size_t maxVoices = 64;
+
+  std::vector<std::vector<float>> floatVoices(maxVoices);
+  std::vector<std::vector<std::int16_t>> intVoices(maxVoices);
+  std::uint32_t noise = 1;
+  for (std::size_t v = 0; v < maxVoices; ++v) {
+    for (std::size_t i = 0; i < frames; ++i) {
+      noise = noise * 1664525u + 1013904223u;
+      auto sample = float(noise >> 8) / float(1u << 24) * 2.0f - 1.0f;
+      floatVoices[v].push_back(sample);
+      intVoices[v].push_back(std::int16_t(sample * 32767.0f));
+    }
+  }
+
+  // mix, gain, clip and convert one block, as the mixer and sink do
+  auto renderFloat = [&](const pcm_kernels& k, std::size_t voices,
+                         std::vector<float>& out,
+                         std::vector<std::int16_t>& converted) {
+    std::fill(out.begin(), out.end(), 0.0f);
+    for (std::size_t v = 0; v < voices; ++v) {
+      k.mix_f32(out.data(), floatVoices[v].data(), 0.25f, frames);
+    }
+    k.gain_f32(out.data(), 0.5f, frames);
+    k.clip_f32(out.data(), frames);
+    k.saturate_f32_to_i16(out.data(), converted.data(), frames);
+  };
+  auto renderInt = [&](const pcm_kernels& k, std::size_t voices,
+                       std::vector<std::int16_t>& out) {
+    std::fill(out.begin(), out.end(), std::int16_t(0));
+    for (std::size_t v = 0; v < voices; ++v) {
+      k.mix_i16(out.data(), intVoices[v].data(), 8192, frames);
+    }
+    k.gain_i16(out.data(), 16384, frames);
+  };
+
+  const auto detected = detect_simd_level();
+  printf("detected %s\n", to_string(detected));
+
+  for (auto level : {simd_level::scalar, simd_level::sse2, simd_level::avx2}) {
+    if (level > detected) {
+      break;
+    }
+    const auto& kernels = get_pcm_kernels(level);
+    for (auto voices : voiceCounts) {
+      std::vector<float> out(frames);
+      std::vector<std::int16_t> converted(frames), intOut(frames);
+
+      char floatName[64], intName[64];
+      snprintf(
+          floatName, sizeof(floatName), "%s f32 block, %zu voices",
+          to_string(level), voices);
+      snprintf(
+          intName, sizeof(intName), "%s i16 block, %zu voices",
+          to_string(level), voices);
+      latency_recorder floatBlock{floatName, iterations};
+      latency_recorder intBlock{intName, iterations};
+      for (int i = 0; i < iterations; ++i) {
+        auto start = clock_t::now();
+        renderFloat(kernels, voices, out, converted);
+        auto middle = clock_t::now();
+        renderInt(kernels, voices, intOut);
+        intBlock.record(clock_t::now() - middle);
+        floatBlock.record(middle - start);
+      }
+      floatBlock.report();
+      intBlock.report();
+    }
+  }
+
+  return 0;
+}
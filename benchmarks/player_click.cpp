@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/sync_wait.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "com_thread.hpp"
+#include "key_event.hpp"
+#include "latency_recorder.hpp"
+#include "player.hpp"
+
+// the cost of Player::Click on the calling thread, which is the time the
+// keyboard consumer spends per keystroke
+int main() {
+  using namespace std::literals::chrono_literals;
+  using clock_t = std::chrono::steady_clock;
+
+  constexpr int bursts = 2000;
+  constexpr int burst = int(Player::spawnCapacity / 2);
+
+  com_thread com{5ms};
+  Player player{
+      com.get_scheduler(), com.get_scheduler(com_thread::priority::high)};
+  unifex::sync_wait(player.start());
+
+  latency_recorder enqueue{"Player::Click enqueue", bursts * burst};
+  latency_recorder drain{"Player::Click burst of 32 to drained", bursts};
+  for (int i = 0; i < bursts; ++i) {
+    auto burstStart = clock_t::now();
+    for (int key = 0; key < burst; ++key) {
+      auto start = clock_t::now();
+      player.Click(key_event{0x0100, std::uint32_t('A' + key % 26)});
+      enqueue.record(clock_t::now() - start);
+    }
+    while (player.spawns_in_flight() > 0) {
+      std::this_thread::yield();
+    }
+    drain.record(clock_t::now() - burstStart);
+  }
+
+  auto dropped = player.dropped_clicks();
+  unifex::sync_wait(player.destroy());
+
+  enqueue.report();
+  drain.report();
+  return dropped == 0 ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/done_as_optional.hpp>
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/task.hpp>
+#include <unifex/timed_single_thread_context.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#include "key_event.hpp"
+#include "manual_event_source.hpp"
+#include "range_adaptors.hpp"
+
+namespace {
+using namespace std::literals::chrono_literals;
+
+constexpr std::size_t bursts = 50;
+constexpr std::size_t perBurst = 20;
+
+template <typename Range>
+unifex::task<void> consume(Range& range, std::size_t& received) {
+  for (auto next : range) {
+    auto event = co_await unifex::done_as_optional(std::move(next));
+    if (!event) {
+      break;
+    }
+    ++received;
+  }
+  co_return;
+}
+
+// auto-repeat bursts of one key, 100us apart, with 20ms between bursts.
+// each burst is a different key than the one before it.
+template <typename Adapt>
+void run(const char* name, Adapt adapt) {
+  manual_event_source<key_event> source;
+  unifex::inplace_stop_source stop;
+  auto range = create_buffered_event_sender_range<key_event, 1024>(
+      stop.get_token(),
+      overflow_policy::block,
+      source.register_fn(),
+      source.unregister_fn());
+  auto adapted = adapt(range.view());
+
+  std::thread producer{[&]() {
+    for (std::size_t b = 0; b < bursts; ++b) {
+      for (std::size_t i = 0; i < perBurst; ++i) {
+        source.emit(key_event{0x0100, std::uint32_t(0x41 + b % 2)});
+        std::this_thread::sleep_for(100us);
+      }
+      std::this_thread::sleep_for(20ms);
+    }
+    stop.request_stop();
+  }};
+
+  std::size_t received = 0;
+  unifex::sync_wait(consume(adapted, received));
+  producer.join();
+
+  printf("%-44s %zu of %zu events\n", name, received, bursts * perBurst);
+}
+}  // namespace
+
+// how many of the events in a burst of auto-repeat each adaptor lets through
+int main() {
+  unifex::timed_single_thread_context timer;
+  auto scheduler = timer.get_scheduler();
+
+  run("distinct_until_changed", [](auto view) {
+    return distinct_until_changed(std::move(view));
+  });
+  run("throttle, 5ms", [&](auto view) {
+    return throttle(std::move(view), scheduler, 5ms);
+  });
+  run("debounce, 5ms", [&](auto view) {
+    return debounce(std::move(view), scheduler, 5ms);
+  });
+  run("coalesce, 5ms", [&](auto view) {
+    return coalesce(std::move(view), scheduler, 5ms);
+  });
+  return 0;
+}
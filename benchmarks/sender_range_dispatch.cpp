@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/done_as_optional.hpp>
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/task.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "latency_recorder.hpp"
+#include "manual_event_source.hpp"
+#include "sender_range.hpp"
+
+namespace {
+using steady_clock = std::chrono::steady_clock;
+
+struct stamped_event {
+  steady_clock::time_point sent_{};
+  bool flood_{false};
+};
+
+template <typename Range>
+unifex::task<void> consume(
+    Range& range,
+    latency_recorder& oneAtATime,
+    latency_recorder& flood,
+    std::atomic<std::size_t>& consumed) {
+  for (auto next : range.view()) {
+    auto event = co_await unifex::done_as_optional(std::move(next));
+    if (!event) {
+      break;
+    }
+    (event->flood_ ? flood : oneAtATime)
+        .record(steady_clock::now() - event->sent_);
+    consumed.fetch_add(1, std::memory_order_release);
+  }
+  co_return;
+}
+}  // namespace
+
+// dispatch from a producer thread to one consumer, first one event at a
+// time and then as fast as the producer can push
+int main() {
+  constexpr std::size_t events = 200000;
+
+  manual_event_source<stamped_event> source;
+  unifex::inplace_stop_source stop;
+  auto range = create_buffered_event_sender_range<stamped_event, 1024>(
+      stop.get_token(),
+      overflow_policy::block,
+      source.register_fn(),
+      source.unregister_fn());
+
+  latency_recorder oneAtATime{"sender_range dispatch, one at a time", events};
+  latency_recorder flood{"sender_range dispatch, flooded", events};
+  std::atomic<std::size_t> consumed{0};
+  steady_clock::duration floodTime{};
+
+  std::thread producer{[&]() {
+    for (std::size_t i = 0; i < events; ++i) {
+      source.emit(stamped_event{steady_clock::now(), false});
+      while (consumed.load(std::memory_order_acquire) <= i) {
+        std::this_thread::yield();
+      }
+    }
+    auto start = steady_clock::now();
+    for (std::size_t i = 0; i < events; ++i) {
+      source.emit(stamped_event{steady_clock::now(), true});
+    }
+    while (consumed.load(std::memory_order_acquire) < 2 * events) {
+      std::this_thread::yield();
+    }
+    floodTime = steady_clock::now() - start;
+    stop.request_stop();
+  }};
+
+  unifex::sync_wait(consume(range, oneAtATime, flood, consumed));
+  producer.join();
+
+  oneAtATime.report();
+  flood.report();
+  printf(
+      "%-44s %.0f events/s, %zu queued\n",
+      "sender_range throughput",
+      events / std::chrono::duration<double>(floodTime).count(),
+      range.queued_events());
+  return 0;
+}
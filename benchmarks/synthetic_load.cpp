@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unifex/done_as_optional.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/task.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "latency_recorder.hpp"
+#include "synthetic_events.hpp"
+
+namespace {
+using steady_clock = std::chrono::steady_clock;
+
+struct stamped_event {
+  steady_clock::time_point sent_{};
+};
+
+stamped_event stamp(std::size_t, std::uint64_t) noexcept {
+  return stamped_event{steady_clock::now()};
+}
+
+template <typename Source>
+unifex::task<void> consume(
+    Source& source,
+    latency_recorder& latency,
+    std::atomic<std::uint64_t>& received) {
+  for (auto next : source.batches()) {
+    auto batch = co_await unifex::done_as_optional(std::move(next));
+    if (!batch) {
+      break;
+    }
+    auto now = steady_clock::now();
+    for (auto& event : *batch) {
+      latency.record(now - event.sent_);
+    }
+    received.fetch_add(batch->size(), std::memory_order_release);
+  }
+  co_return;
+}
+}  // namespace
+
+// drives sender_range from synthetic producers at 10k to 1M events per
+// second and reports the dispatch latency and what was kept up with
+int main() {
+  using namespace std::literals::chrono_literals;
+
+  struct load {
+    const char* name_;
+    synthetic_schedule schedule_;
+  };
+  std::vector<load> loads{
+      {"constant 10k/s, 1 producer",
+       synthetic_schedule::constant(10000, 1, 5000)},
+      {"constant 100k/s, 1 producer",
+       synthetic_schedule::constant(100000, 1, 50000)},
+      {"poisson 100k/s, 2 producers",
+       synthetic_schedule::poisson(100000, 2, 50000)},
+      {"constant 1M/s, 4 producers",
+       synthetic_schedule::constant(1000000, 4, 500000)},
+      {"bursts of 50 at 1M/s every 5ms",
+       synthetic_schedule::recorded({{50, 1us, 5ms}}, 1, 5000)}};
+
+  int failures = 0;
+  for (auto& l : loads) {
+    const auto total = l.schedule_.totalEvents_;
+    synthetic_event_source<stamped_event, 4096> source{l.schedule_, &stamp};
+    latency_recorder latency{l.name_, total};
+    std::atomic<std::uint64_t> received{0};
+
+    auto start = steady_clock::now();
+    std::thread stopper{[&]() {
+      while (source.emitted() < total) {
+        std::this_thread::sleep_for(1ms);
+      }
+      // let the consumer catch up with what is still buffered
+      auto deadline = steady_clock::now() + 1s;
+      while (received.load(std::memory_order_acquire) +
+                     source.dropped_events() <
+                 total &&
+             steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+      }
+      unifex::sync_wait(source.destroy());
+    }};
+    unifex::sync_wait(source.start());
+    unifex::sync_wait(consume(source, latency, received));
+    stopper.join();
+    auto elapsed = std::chrono::duration<double>(steady_clock::now() - start);
+
+    latency.report();
+    printf(
+        "%-44s %.0f events/s, %zu queued, %zu dropped\n",
+        "",
+        received.load() / elapsed.count(),
+        source.queued_events(),
+        source.dropped_events());
+    if (received.load() + source.dropped_events() != total) {
+      ++failures;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// always traced, whatever the build was configured with
+#if !defined(KBRDHOOK_ENABLE_TRACING)
+#  define KBRDHOOK_ENABLE_TRACING 1
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "key_event.hpp"
+#include "latency_recorder.hpp"
+#include "trace.hpp"
+
+// measures the cost of a trace point and checks the histogram percentiles
+int main() {
+  using clock_t = std::chrono::steady_clock;
+
+  int failures = 0;
+
+  // values 1..100000 put the percentiles at known places
+  latency_histogram histogram;
+  for (std::uint64_t v = 1; v <= 100000; ++v) {
+    histogram.record(v);
+  }
+  for (double p : {0.5, 0.9, 0.99, 0.999}) {
+    auto expected = p * 100000.0;
+    auto actual = double(histogram.percentile(p));
+    // one bucket is at most 1/16th of its value wide
+    if (actual < expected || actual > expected * (1.0 + 1.0 / 16.0) + 1.0) {
+      printf("p%g: expected about %.0f, got %.0f\n", p * 100, expected, actual);
+      ++failures;
+    }
+  }
+  if (histogram.percentile(1.0) != 100000) {
+    ++failures;
+  }
+
+  // four hops per event from each of four threads, like a keystroke. each
+  // sample is the average cost over a batch of events.
+  constexpr int threads = 4;
+  constexpr int batches = 2000;
+  constexpr int batch = 100;
+  std::vector<std::vector<clock_t::duration>> elapsed(threads);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&samples = elapsed[t]]() {
+      samples.reserve(batches);
+      for (int b = 0; b < batches; ++b) {
+        auto start = clock_t::now();
+        for (int i = 0; i < batch; ++i) {
+          key_event event{0x0100, 0x41};
+          trace_begin(event);
+          trace_point(trace_stage::dispatch, event);
+          trace_point(trace_stage::resume, event);
+          trace_point(trace_stage::spawn, event);
+          trace_end(trace_stage::click, event);
+        }
+        samples.push_back(clock_t::now() - start);
+      }
+    });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+  latency_recorder perPoint{"trace point", threads * batches};
+  for (auto& samples : elapsed) {
+    for (auto& e : samples) {
+      // five samples per event
+      perPoint.record(e / (batch * 5));
+    }
+  }
+  perPoint.report();
+
+  // samples may only be lost when a collector stalls for longer than it
+  // takes to fill a buffer
+  constexpr auto samples = std::uint64_t(threads) * batches * batch * 5;
+  auto dropped = trace_dropped();
+  if (dropped > samples / 1000) {
+    printf(
+        "%llu of %llu samples dropped\n",
+        static_cast<unsigned long long>(dropped),
+        static_cast<unsigned long long>(samples));
+    ++failures;
+  }
+
+  trace_dump(stdout);
+  return failures == 0 ? 0 : 1;
+}
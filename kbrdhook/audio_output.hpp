@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "audio_ring.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+// plays a Source (a mixer) through a Sink with two threads.
+//
+// the mixer thread renders ahead into an audio_ring until aheadFrames are
+// queued. the device thread takes one block at a time from the ring and
+// writes it to the sink, which paces it at the sample clock (a timer for
+// null_sink and wav_file_sink, the device for waveout_sink). when the ring
+// runs dry the rest of the block is silence and counted as an underrun.
+//
+// the mixer renders whole blocks, so aheadFrames is rounded up to a whole
+// number of blocks. a trigger is heard after at most that many frames plus
+// the sink's own buffering.
+template <typename Source, typename Sink, std::size_t RingFrames = 4096>
+class audio_output {
+public:
+  static inline constexpr std::size_t blockFrames = 256;
+  static_assert(RingFrames >= 2 * blockFrames);
+
+private:
+  Source& source_;
+  Sink sink_;
+  std::size_t aheadFrames_;
+  audio_ring<RingFrames> ring_;
+  std::atomic<bool> stop_{false};
+  // bumped by the device thread after each block, the mixer thread waits on
+  // it while the ring is full enough
+  std::atomic<std::uint32_t> consumed_{0};
+  std::atomic<std::size_t> underruns_{0};
+  std::atomic<std::size_t> minimumFill_{RingFrames};
+  std::thread mixerThread_;
+  std::thread deviceThread_;
+
+  void mix() noexcept {
+    std::array<float, blockFrames> block;
+    while (!stop_.load(std::memory_order_acquire)) {
+      auto consumed = consumed_.load(std::memory_order_acquire);
+      if (ring_.size() + blockFrames > aheadFrames_) {
+        consumed_.wait(consumed, std::memory_order_acquire);
+        continue;
+      }
+      source_.render(block);
+      (void)ring_.write(block);
+    }
+  }
+
+  void play() noexcept {
+    // let the mixer get ahead before the first block
+    while (ring_.size() < aheadFrames_ &&
+           !stop_.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    std::array<float, blockFrames> block;
+    while (!stop_.load(std::memory_order_acquire)) {
+      auto fill = ring_.size();
+      if (fill < minimumFill_.load(std::memory_order_relaxed)) {
+        minimumFill_.store(fill, std::memory_order_relaxed);
+      }
+      auto count = ring_.read(block);
+      if (count < block.size()) {
+        underruns_.fetch_add(1, std::memory_order_relaxed);
+        std::fill(block.begin() + count, block.end(), 0.0f);
+      }
+      consumed_.fetch_add(1, std::memory_order_release);
+      consumed_.notify_one();
+      sink_.write(block);
+    }
+  }
+
+public:
+  template <typename... SinkArgs>
+  explicit audio_output(
+      Source& source, std::size_t aheadFrames, SinkArgs&&... sinkArgs)
+    : source_(source)
+    , sink_((SinkArgs &&) sinkArgs...)
+    , aheadFrames_(std::clamp(
+          (aheadFrames + blockFrames - 1) / blockFrames * blockFrames,
+          blockFrames,
+          RingFrames))
+    , mixerThread_([this]() noexcept { mix(); })
+    , deviceThread_([this]() noexcept { play(); }) {}
+  audio_output(const audio_output&) = delete;
+  ~audio_output() {
+    stop_.store(true, std::memory_order_release);
+    consumed_.fetch_add(1, std::memory_order_release);
+    consumed_.notify_one();
+    mixerThread_.join();
+    deviceThread_.join();
+  }
+
+  // blocks the device thread had to pad with silence
+  std::size_t underruns() const noexcept {
+    return underruns_.load(std::memory_order_relaxed);
+  }
+  // how far the mixer renders ahead, in frames
+  std::size_t ahead_frames() const noexcept { return aheadFrames_; }
+  // frames queued between the mixer and the device right now
+  std::size_t fill_level() const noexcept { return ring_.size(); }
+  // the lowest fill level the device thread has seen
+  std::size_t minimum_fill_level() const noexcept {
+    return minimumFill_.load(std::memory_order_relaxed);
+  }
+};
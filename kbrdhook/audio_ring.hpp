@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// a single producer, single consumer ring of mono PCM frames. the producer
+// only writes writePosition_ and the consumer only writes readPosition_, so
+// neither side ever waits on the other.
+template <std::size_t Capacity>
+class audio_ring {
+  static_assert(
+      Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+      "the capacity must be a power of two");
+  static inline constexpr std::size_t mask = Capacity - 1;
+
+  // each position on its own cache line
+  alignas(64) std::atomic<std::uint64_t> writePosition_{0};
+  alignas(64) std::atomic<std::uint64_t> readPosition_{0};
+  alignas(64) float frames_[Capacity];
+
+  // copy into or out of the ring, wrapping at the end
+  template <typename Copy>
+  static void
+  wrapped(std::uint64_t position, std::size_t count, Copy copy) noexcept {
+    auto first = static_cast<std::size_t>(position & mask);
+    auto head = std::min(count, Capacity - first);
+    copy(first, 0, head);
+    copy(0, head, count - head);
+  }
+
+public:
+  static inline constexpr std::size_t capacity = Capacity;
+
+  // frames written and not yet read. exact on either thread for its own
+  // side, approximate elsewhere.
+  std::size_t size() const noexcept {
+    return static_cast<std::size_t>(
+        writePosition_.load(std::memory_order_acquire) -
+        readPosition_.load(std::memory_order_acquire));
+  }
+
+  // producer only. returns the number of frames written.
+  std::size_t write(std::span<const float> in) noexcept {
+    auto write = writePosition_.load(std::memory_order_relaxed);
+    auto read = readPosition_.load(std::memory_order_acquire);
+    auto count = std::min<std::size_t>(
+        in.size(), Capacity - static_cast<std::size_t>(write - read));
+    wrapped(write, count, [&](std::size_t at, std::size_t from, std::size_t n) {
+      std::copy_n(in.data() + from, n, frames_ + at);
+    });
+    writePosition_.store(write + count, std::memory_order_release);
+    return count;
+  }
+
+  // consumer only. returns the number of frames read.
+  std::size_t read(std::span<float> out) noexcept {
+    auto read = readPosition_.load(std::memory_order_relaxed);
+    auto write = writePosition_.load(std::memory_order_acquire);
+    auto count = std::min<std::size_t>(
+        out.size(), static_cast<std::size_t>(write - read));
+    wrapped(read, count, [&](std::size_t at, std::size_t to, std::size_t n) {
+      std::copy_n(frames_ + at, n, out.data() + to);
+    });
+    readPosition_.store(read + count, std::memory_order_release);
+    return count;
+  }
+};
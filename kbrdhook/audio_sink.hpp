@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#if defined(_WIN32)
+#  include <windows.h>
+#  include <mmsystem.h>
+#  pragma comment(lib, "winmm.lib")
+#endif
+
+#include "pcm_kernels.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// sinks take blocks of mono float samples from the mixer. write() blocks
+// until the sink can take the next block, which paces the audio thread.
+
+// float in [-1, 1] to int16, saturating
+inline void to_int16(std::span<const float> in, std::span<std::int16_t> out) {
+  active_pcm_kernels().saturate_f32_to_i16(in.data(), out.data(), in.size());
+}
+
+// paces writes at the sample rate for sinks without a device clock
+class sample_clock {
+  using clock_t = std::chrono::steady_clock;
+  std::uint32_t sampleRate_;
+  std::uint64_t frames_{0};
+  clock_t::time_point origin_{};
+
+public:
+  explicit sample_clock(std::uint32_t sampleRate) : sampleRate_(sampleRate) {}
+
+  // sleep until the previous blocks have been played
+  void wait(std::size_t frames) {
+    if (frames_ == 0) {
+      origin_ = clock_t::now();
+    }
+    std::this_thread::sleep_until(
+        origin_ +
+        std::chrono::duration_cast<clock_t::duration>(
+            std::chrono::duration<double>(double(frames_) / sampleRate_)));
+    frames_ += frames;
+  }
+};
+
+// discards the samples in real time
+class null_sink {
+  sample_clock clock_;
+
+public:
+  explicit null_sink(std::uint32_t sampleRate) : clock_(sampleRate) {}
+
+  void write(std::span<const float> block) { clock_.wait(block.size()); }
+};
+
+// records the samples to a 16 bit mono wav file in real time
+class wav_file_sink {
+  FILE* file_;
+  std::uint32_t sampleRate_;
+  std::uint32_t dataBytes_{0};
+  sample_clock clock_;
+  std::vector<std::int16_t> converted_;
+
+  void write_header() {
+    auto u32 = [this](std::uint32_t v) {
+      std::uint8_t bytes[4] = {
+          std::uint8_t(v), std::uint8_t(v >> 8), std::uint8_t(v >> 16),
+          std::uint8_t(v >> 24)};
+      fwrite(bytes, 1, 4, file_);
+    };
+    auto u16 = [this](std::uint16_t v) {
+      std::uint8_t bytes[2] = {std::uint8_t(v), std::uint8_t(v >> 8)};
+      fwrite(bytes, 1, 2, file_);
+    };
+    fseek(file_, 0, SEEK_SET);
+    fwrite("RIFF", 1, 4, file_);
+    u32(36 + dataBytes_);
+    fwrite("WAVEfmt ", 1, 8, file_);
+    u32(16);
+    u16(1);  // PCM
+    u16(1);  // mono
+    u32(sampleRate_);
+    u32(sampleRate_ * 2);
+    u16(2);
+    u16(16);
+    fwrite("data", 1, 4, file_);
+    u32(dataBytes_);
+  }
+
+public:
+  wav_file_sink(const char* path, std::uint32_t sampleRate)
+    : file_(fopen(path, "wb"))
+    , sampleRate_(sampleRate)
+    , clock_(sampleRate) {
+    if (!file_) {
+      std::terminate();
+    }
+    write_header();
+  }
+  wav_file_sink(const wav_file_sink&) = delete;
+  // fills in the sizes in the header
+  ~wav_file_sink() {
+    write_header();
+    fclose(file_);
+  }
+
+  void write(std::span<const float> block) {
+    converted_.resize(block.size());
+    to_int16(block, converted_);
+    fwrite(converted_.data(), sizeof(std::int16_t), converted_.size(), file_);
+    dataBytes_ += std::uint32_t(converted_.size() * sizeof(std::int16_t));
+    clock_.wait(block.size());
+  }
+};
+
+#if defined(_WIN32)
+// plays the samples through the default waveOut device. write() waits for
+// the oldest of the buffers in flight to finish playing.
+//
+// when the device cannot be opened, or a write fails, the error is reported
+// once and the sink carries on as a null_sink. the report goes to stderr and
+// the debugger rather than to a message box, because the sink is opened on
+// the com thread that hosts the keyboard hook and written on the device
+// thread, and neither may block.
+class waveout_sink {
+  static inline constexpr std::size_t bufferCount = 4;
+
+  HWAVEOUT device_{NULL};
+  HANDLE done_;
+  std::array<WAVEHDR, bufferCount> headers_{};
+  std::array<std::vector<std::int16_t>, bufferCount> buffers_;
+  std::size_t next_{0};
+  // paces write() once the device has failed
+  sample_clock fallback_;
+  bool failed_{false};
+
+  void fail(const char* message, long errorCode) noexcept {
+    failed_ = true;
+    char str[MAX_PATH];
+    snprintf(str, sizeof(str), "%s (error=0x%lX)\n", message, errorCode);
+    OutputDebugStringA(str);
+    fputs(str, stderr);
+  }
+
+public:
+  explicit waveout_sink(std::uint32_t sampleRate)
+    : done_(CreateEventW(NULL, FALSE, FALSE, NULL))
+    , fallback_(sampleRate) {
+    if (!done_) {
+      fail("Error creating the audio event",
+           HRESULT_FROM_WIN32(GetLastError()));
+      return;
+    }
+    WAVEFORMATEX format{};
+    format.wFormatTag = WAVE_FORMAT_PCM;
+    format.nChannels = 1;
+    format.nSamplesPerSec = sampleRate;
+    format.wBitsPerSample = 16;
+    format.nBlockAlign = 2;
+    format.nAvgBytesPerSec = sampleRate * 2;
+    auto result = waveOutOpen(
+        &device_,
+        WAVE_MAPPER,
+        &format,
+        reinterpret_cast<DWORD_PTR>(done_),
+        0,
+        CALLBACK_EVENT);
+    if (result != MMSYSERR_NOERROR) {
+      device_ = NULL;
+      fail("Error opening the audio device", long(result));
+    }
+  }
+  waveout_sink(const waveout_sink&) = delete;
+  ~waveout_sink() {
+    if (!!device_) {
+      waveOutReset(device_);
+      for (auto& header : headers_) {
+        if (header.dwFlags & WHDR_PREPARED) {
+          waveOutUnprepareHeader(device_, &header, sizeof(header));
+        }
+      }
+      waveOutClose(device_);
+    }
+    if (!!done_) {
+      CloseHandle(done_);
+    }
+  }
+
+  // the device failed and the samples are discarded
+  bool failed() const noexcept { return failed_; }
+
+  void write(std::span<const float> block) {
+    if (failed_) {
+      fallback_.wait(block.size());
+      return;
+    }
+
+    auto& header = headers_[next_];
+    auto& buffer = buffers_[next_];
+    next_ = (next_ + 1) % bufferCount;
+
+    while (header.dwFlags & WHDR_INQUEUE) {
+      WaitForSingleObject(done_, INFINITE);
+    }
+    if (header.dwFlags & WHDR_PREPARED) {
+      waveOutUnprepareHeader(device_, &header, sizeof(header));
+    }
+
+    buffer.resize(block.size());
+    to_int16(block, buffer);
+    header = WAVEHDR{};
+    header.lpData = reinterpret_cast<LPSTR>(buffer.data());
+    header.dwBufferLength = DWORD(buffer.size() * sizeof(std::int16_t));
+    auto result = waveOutPrepareHeader(device_, &header, sizeof(header));
+    if (result == MMSYSERR_NOERROR) {
+      result = waveOutWrite(device_, &header, sizeof(header));
+    }
+    if (result != MMSYSERR_NOERROR) {
+      fail("Error writing to the audio device", long(result));
+      fallback_.wait(block.size());
+    }
+  }
+};
+#endif
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "event_ring.hpp"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <type_traits>
+
+// fixed-capacity ring where every subscriber sees every event.
+//
+// events are written once into a shared cell. each subscriber has its own
+// cursor (the sequence number of the next event it will read) and reads
+// the event in place. a producer may only reuse a cell after every active
+// subscriber has released the event in it, so the slowest subscriber gates
+// the producers. any number of threads may publish concurrently.
+//
+// drop_oldest is not supported - a subscriber may still be reading the
+// oldest event - and is rejected at construction.
+template <
+    typename EventType,
+    std::size_t Capacity,
+    std::size_t MaxSubscribers>
+class broadcast_ring {
+  static_assert(
+      Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+      "broadcast_ring Capacity must be a power of two");
+  static_assert(
+      std::is_nothrow_default_constructible_v<EventType> &&
+          std::is_nothrow_move_assignable_v<EventType>,
+      "broadcast_ring requires events that can be moved into a cell "
+      "without throwing");
+
+  static inline constexpr std::size_t mask_ = Capacity - 1;
+  static inline constexpr std::uint64_t inactive_ =
+      std::numeric_limits<std::uint64_t>::max();
+
+  struct cell {
+    // sequence + 1 of the event in the cell (0 when never written)
+    std::atomic<std::uint64_t> published_{0};
+    EventType event_{};
+  };
+
+  struct alignas(64) cursor {
+    // sequence of the next event for this subscriber, inactive_ when the
+    // slot is free
+    std::atomic<std::uint64_t> next_{inactive_};
+  };
+
+  alignas(64) std::atomic<std::uint64_t> claim_{0};
+  // cached minimum of the active cursors. it only moves forward.
+  alignas(64) std::atomic<std::uint64_t> gate_{0};
+  alignas(64) std::atomic<std::size_t> published_{0};
+  std::atomic<std::size_t> dropped_{0};
+  std::atomic<bool> closed_{false};
+  overflow_policy policy_;
+  std::array<cursor, MaxSubscribers> cursors_;
+  std::array<cell, Capacity> cells_;
+
+  std::uint64_t min_cursor(std::uint64_t claimed) const noexcept {
+    auto result = claimed;
+    for (auto& c : cursors_) {
+      auto next = c.next_.load(std::memory_order_acquire);
+      if (next != inactive_ && next < result) {
+        result = next;
+      }
+    }
+    return result;
+  }
+
+public:
+  static inline constexpr std::size_t capacity = Capacity;
+  static inline constexpr std::size_t max_subscribers = MaxSubscribers;
+
+  explicit broadcast_ring(overflow_policy policy = overflow_policy::drop_newest)
+    : policy_(policy) {
+    assert(
+        policy != overflow_policy::drop_oldest &&
+        "broadcast_ring supports drop_newest and block");
+  }
+  broadcast_ring(broadcast_ring&&) = delete;
+
+  overflow_policy policy() const noexcept { return policy_; }
+
+  // the subscribers have gone. like event_ring::close(), producers blocked
+  // by overflow_policy::block discard their events.
+  void close() noexcept { closed_.store(true, std::memory_order_release); }
+  bool closed() const noexcept {
+    return closed_.load(std::memory_order_acquire);
+  }
+
+  // total number of events written to the ring
+  std::size_t queued_count() const noexcept {
+    return published_.load(std::memory_order_relaxed);
+  }
+  // total number of events discarded because the slowest subscriber had
+  // not released the cell they needed
+  std::size_t dropped_count() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  // returns the id of a free subscriber slot, or max_subscribers when all
+  // the slots are in use. the subscriber starts with the next event
+  // published.
+  std::size_t subscribe() noexcept {
+    for (std::size_t id = 0; id < MaxSubscribers; ++id) {
+      auto expected = inactive_;
+      if (cursors_[id].next_.compare_exchange_strong(
+              expected, claim_.load(std::memory_order_acquire))) {
+        return id;
+      }
+    }
+    return MaxSubscribers;
+  }
+
+  void unsubscribe(std::size_t id) noexcept {
+    cursors_[id].next_.store(inactive_, std::memory_order_release);
+  }
+
+  // true when the subscriber has an event to read
+  bool ready(std::size_t id) const noexcept {
+    auto next = cursors_[id].next_.load(std::memory_order_relaxed);
+    if (next == inactive_) {
+      return false;
+    }
+    return cells_[next & mask_].published_.load(std::memory_order_acquire) >
+        next;
+  }
+
+  // the next event for the subscriber, read in place. nullptr when none
+  // has been published yet.
+  //
+  // only the thread that currently owns delivery for this subscriber may
+  // call peek() and release()
+  EventType* peek(std::size_t id) noexcept {
+    auto& c = cursors_[id];
+    auto next = c.next_.load(std::memory_order_relaxed);
+    if (next == inactive_) {
+      return nullptr;
+    }
+    for (;;) {
+      auto& slot = cells_[next & mask_];
+      auto published = slot.published_.load(std::memory_order_acquire);
+      if (published == next + 1) {
+        return &slot.event_;
+      }
+      if (published <= next) {
+        return nullptr;
+      }
+      // the cell was reused before this subscriber joined the gate (only
+      // possible for events claimed while subscribe() was running). skip,
+      // unless unsubscribe() has freed the slot in the meantime.
+      if (!c.next_.compare_exchange_strong(
+              next, next + 1, std::memory_order_acq_rel)) {
+        return nullptr;
+      }
+      ++next;
+    }
+  }
+
+  // the subscriber is done with the event returned from peek()
+  void release(std::size_t id) noexcept {
+    cursors_[id].next_.fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  // write the event into the next cell. returns false if the event was
+  // discarded because the ring is full (or closed while blocked).
+  bool publish(EventType event) noexcept {
+    auto claimed = claim_.load(std::memory_order_relaxed);
+    for (;;) {
+      if (claimed - gate_.load(std::memory_order_acquire) >= Capacity) {
+        auto gate = min_cursor(claimed);
+        auto cached = gate_.load(std::memory_order_relaxed);
+        while (cached < gate &&
+               !gate_.compare_exchange_weak(
+                   cached, gate, std::memory_order_release)) {
+        }
+        if (claimed - gate >= Capacity) {
+          if (policy_ != overflow_policy::block || closed()) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+          }
+          std::this_thread::yield();
+          claimed = claim_.load(std::memory_order_relaxed);
+          continue;
+        }
+      }
+      if (claim_.compare_exchange_weak(
+              claimed, claimed + 1, std::memory_order_acq_rel)) {
+        break;
+      }
+    }
+    auto& slot = cells_[claimed & mask_];
+    slot.event_ = std::move(event);
+    slot.published_.store(claimed + 1, std::memory_order_release);
+    published_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+};
@@ -25,11 +25,20 @@
 
 #include "com_thread.hpp"
 
-#include <windows.h>
-#include <windowsx.h>
-#include <winuser.h>
+#if defined(_WIN32)
+#  include <windows.h>
+#  include <windowsx.h>
+#  include <winuser.h>
+#else
+#  include <csignal>
+#  include <thread>
+
+#  include <unistd.h>
+#endif
 
 #include <atomic>
+#include <cstdio>
+#include <utility>
 
 struct clean_stop {
   using scheduler_t = decltype(std::declval<com_thread>().get_scheduler());
@@ -38,6 +47,14 @@ struct clean_stop {
 
   scheduler_t uiLoop_;
   unifex::inplace_stop_source stopSource_;
+#if !defined(_WIN32)
+  // the signal handler can only do async-signal-safe things, so it writes
+  // to a pipe and signalThread_ requests the stop
+  static inline std::atomic<int> signalPipe_{-1};
+  int pipe_[2] = {-1, -1};
+  std::thread signalThread_;
+  struct sigaction previous_ = {};
+#endif
 
   [[nodiscard]] auto start() {
     return unifex::sequence(
@@ -45,17 +62,47 @@ struct clean_stop {
           if (stop_.exchange(&stopSource_) != nullptr) {
             std::terminate();
           }
+#if defined(_WIN32)
           if (!SetConsoleCtrlHandler(&consoleHandler, TRUE)) {
             std::terminate();
           }
+#else
+          if (pipe(pipe_) != 0) {
+            std::terminate();
+          }
+          signalThread_ = std::thread{[this]() noexcept {
+            char signal = 0;
+            while (read(pipe_[0], &signal, 1) == 1 && signal == 'i') {
+              printf("\n");  // end the line of '.'
+              stop_.load()->request_stop();
+            }
+          }};
+          signalPipe_.store(pipe_[1]);
+          struct sigaction action = {};
+          action.sa_handler = &signalHandler;
+          sigemptyset(&action.sa_mask);
+          if (sigaction(SIGINT, &action, &previous_) != 0) {
+            std::terminate();
+          }
+#endif
         }));
   }
   [[nodiscard]] auto destroy() {
     return unifex::sequence(
         unifex::schedule(uiLoop_), unifex::just_from([this]() {
+#if defined(_WIN32)
           if (!SetConsoleCtrlHandler(&consoleHandler, FALSE)) {
             std::terminate();
           }
+#else
+          if (sigaction(SIGINT, &previous_, nullptr) != 0) {
+            std::terminate();
+          }
+          signalPipe_.store(-1);
+          close(std::exchange(pipe_[1], -1));  // ends signalThread_
+          signalThread_.join();
+          close(std::exchange(pipe_[0], -1));
+#endif
           if (stop_.exchange(nullptr) == nullptr) {
             std::terminate();
           }
@@ -84,6 +131,7 @@ struct clean_stop {
   };
   [[nodiscard]] auto event() { return unifex::create(make_event{this}); }
 
+#if defined(_WIN32)
   static BOOL WINAPI consoleHandler(DWORD signal) {
     if (signal == CTRL_C_EVENT) {
       printf("\n");  // end the line of '.'
@@ -91,6 +139,14 @@ struct clean_stop {
     }
     return TRUE;
   }
+#else
+  static void signalHandler(int) {
+    int fd = signalPipe_.load();
+    if (fd >= 0) {
+      (void)!write(fd, "i", 1);
+    }
+  }
+#endif
 
   ~clean_stop() {
     if (stop_.load() != nullptr) {
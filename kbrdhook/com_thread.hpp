@@ -16,151 +16,501 @@
 
 #pragma once
 
-#include <unifex/just.hpp>
-#include <unifex/let_done.hpp>
-#include <unifex/manual_event_loop.hpp>
-#include <unifex/repeat_effect_until.hpp>
+#include <unifex/create.hpp>
+#include <unifex/receiver_concepts.hpp>
 #include <unifex/scheduler_concepts.hpp>
+#include <unifex/scope_guard.hpp>
 #include <unifex/sender_concepts.hpp>
-#include <unifex/stop_when.hpp>
-#include <unifex/sync_wait.hpp>
-#include <unifex/timed_single_thread_context.hpp>
+#include <unifex/stop_token_concepts.hpp>
 
+#include <unifex/detail/atomic_intrusive_queue.hpp>
+#include <unifex/detail/intrusive_queue.hpp>
+
+#if defined(_WIN32)
+#  include "win32_message_loop.hpp"
+#else
+#  include "epoll_message_loop.hpp"
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <thread>
 
-#include <windows.h>
-#include <windowsx.h>
-#include <winuser.h>
+#if defined(_WIN32)
+using com_message_loop = win32_message_loop;
+#else
+using com_message_loop = epoll_message_loop;
+#endif
 
 struct com_thread {
-  using run_scheduler_t =
-      decltype(std::declval<unifex::manual_event_loop&>().get_scheduler());
-  using time_scheduler_t =
-      decltype(std::declval<unifex::timed_single_thread_context>()
-                   .get_scheduler());
-  using duration_t =
-      typename unifex::timed_single_thread_context::clock_t::duration;
-  duration_t maxTime_;
-  unifex::timed_single_thread_context time_;
-  unifex::manual_event_loop run_;
+  using clock_t = std::chrono::steady_clock;
+  using duration_t = clock_t::duration;
+
+  // an operation scheduled onto the com thread
+  struct task {
+    void (*execute_)(task*) noexcept;
+    task* next_{nullptr};
+    // when enqueue() was called, in clock_t ticks
+    duration_t::rep enqueued_{0};
+    // names the task in stall reports, see _scheduler::with_label()
+    const char* label_{nullptr};
+  };
+
+  // a counter on a cache line of its own, so that the com thread and the
+  // threads scheduling onto it do not contend on each other's counters
+  struct alignas(64) padded_counter {
+    std::atomic<std::uint64_t> value_{0};
+
+    void add(std::uint64_t n) noexcept {
+      value_.fetch_add(n, std::memory_order_relaxed);
+    }
+    void sub(std::uint64_t n) noexcept {
+      value_.fetch_sub(n, std::memory_order_relaxed);
+    }
+    // only called from the com thread, so a plain store is enough
+    void raise_to(std::uint64_t n) noexcept {
+      if (n > value_.load(std::memory_order_relaxed)) {
+        value_.store(n, std::memory_order_relaxed);
+      }
+    }
+    std::uint64_t load() const noexcept {
+      return value_.load(std::memory_order_relaxed);
+    }
+  };
+
+  // written by the com thread as it drains, read by com_thread_watchdog
+  struct alignas(64) heartbeat {
+    // when the running drain started, in clock_t ticks. 0 between drains.
+    std::atomic<duration_t::rep> drainStart_{0};
+    // tasks the running drain has finished
+    std::atomic<std::uint64_t> tasksRun_{0};
+    // the label of the task running now
+    std::atomic<const char*> label_{nullptr};
+  };
+
+  // a copy of the counters at one point in time. the counters are read one
+  // at a time so they may be a few tasks apart.
+  struct stats {
+    // tasks scheduled and not yet run
+    std::uint64_t queueDepth_;
+    std::uint64_t drains_;
+    std::uint64_t tasksRun_;
+    std::uint64_t maxTasksPerDrain_;
+    // time the loop spent dispatching platform messages
+    duration_t dispatchTime_;
+    // time the loop spent running queued tasks
+    duration_t drainTime_;
+    // schedule() calls that woke the loop
+    std::uint64_t wakesPosted_;
+    // schedule() calls that found a wakeup already on its way
+    std::uint64_t wakesCoalesced_;
+    // the longest a task waited between schedule() and running
+    duration_t maxScheduleDelay_;
+    // drains that ran out of time with work still queued
+    std::uint64_t budgetExpirations_;
+
+    double tasks_per_drain() const noexcept {
+      return drains_ == 0 ? 0.0 : double(tasksRun_) / double(drains_);
+    }
+    // the share of the busy time that went to queued tasks
+    double drain_share() const noexcept {
+      auto busy = dispatchTime_ + drainTime_;
+      return busy.count() == 0 ? 0.0
+                               : double(drainTime_.count()) / busy.count();
+    }
+  };
+
+  // lanes are drained in this order
+  enum class priority { high, normal, background };
+  static inline constexpr std::size_t priorityCount = 3;
+
+  // the clock is only read after this many tasks have run
+  static inline constexpr std::size_t budgetCheckInterval = 16;
+
+  // a lane with work waiting runs next once higher lanes have been picked
+  // ahead of it this many times
+  static inline constexpr std::size_t starvationLimit = 32;
+
+  // bounds for a time slice that follows the load. the slice shrinks when
+  // messages wait longer than targetLatency_ and grows when work is still
+  // queued at the end of a slice.
+  struct adaptive_slice {
+    duration_t min_;
+    duration_t max_;
+    duration_t targetLatency_;
+  };
+
+  adaptive_slice bounds_;
+  // how long queued work may hold off message dispatch right now
+  std::atomic<duration_t::rep> slice_;
+  // tasks that have been scheduled and not yet run
+  padded_counter queueDepth_;
+  // tasks scheduled from any thread, one queue per priority
+  std::array<
+      unifex::atomic_intrusive_queue<task, &task::next_>,
+      priorityCount>
+      queues_;
+  // tasks taken from queues_ that have not run yet. only used on the com
+  // thread.
+  std::array<unifex::intrusive_queue<task, &task::next_>, priorityCount>
+      ready_;
+  // how many times each lane has been passed over while it had work
+  std::array<std::size_t, priorityCount> waited_{};
+  // number of drains that ran out of time before the queue was empty
+  padded_counter budgetExpirations_;
+  // the rest of the counters behind snapshot()
+  padded_counter drains_;
+  padded_counter tasksRun_;
+  padded_counter maxTasksPerDrain_;
+  padded_counter dispatchTime_;
+  padded_counter drainTime_;
+  padded_counter wakesPosted_;
+  padded_counter wakesCoalesced_;
+  padded_counter maxScheduleDelay_;
+  heartbeat heartbeat_;
+  // platform messages and wakeups
+  com_message_loop loop_;
+  // set by the first schedule() after the loop starts a drain. the rest do
+  // not need to wake the loop.
+  std::atomic<bool> wakePending_{false};
+  // shutdown handshake. started_ is set once the loop can receive wakeups,
+  // exited_ once the loop has drained and released the platform state.
+  std::atomic<bool> started_{false};
+  std::atomic<bool> exited_{false};
   std::thread comThread_;
   ~com_thread() { join(); }
   com_thread() = delete;
+  // a fixed time slice
   explicit com_thread(duration_t maxTime)
-    : maxTime_(maxTime)
+    : com_thread(adaptive_slice{maxTime, maxTime, maxTime}) {}
+  explicit com_thread(adaptive_slice bounds)
+    : bounds_(bounds)
+    , slice_(bounds.max_.count())
     , comThread_([this]() noexcept {
-      {  // create message queue
-        MSG msg;
-        PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
-      }
+      loop_.attach();
+      started_.store(true, std::memory_order_release);
+      started_.notify_all();
+
       printf("com thread start\n");
       fflush(stdout);
 
-      if (FAILED(CoInitializeEx(
-              nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE))) {
-        std::terminate();
-      }
-
       unifex::scope_guard exit{[this]() noexcept {
-        run_.stop();
-        run_.run();  // run until empty
+        // run until empty
+        while (!drain(clock_t::now(), clock_t::time_point::max())) {
+        }
 
-        CoUninitialize();
+        loop_.detach();
 
         printf("com thread exit\n");
         fflush(stdout);
+
+        exited_.store(true, std::memory_order_release);
+        exited_.notify_all();
       }};
 
-      BOOL pendingMessages = FALSE;
-      MSG msg = {};
-      while ((pendingMessages = GetMessage(&msg, NULL, 0, 0)) != 0) {
-        if (pendingMessages == -1) {
-          std::terminate();
+      while (loop_.wait()) {
+        dispatchTime_.add(std::uint64_t(loop_.dispatch_time().count()));
+        // anything scheduled from here on is either drained below or
+        // posts a new wakeup
+        wakePending_.store(false, std::memory_order_seq_cst);
+        auto start = clock_t::now();
+        auto drained = drain(start, start + current_slice());
+        drainTime_.add(std::uint64_t((clock_t::now() - start).count()));
+        if (!drained) {
+          // the slice expired before the queue was empty. the wakeups for the
+          // rest were coalesced, so come back for it after pending messages.
+          budgetExpirations_.add(1);
+          wakePending_.store(true, std::memory_order_seq_cst);
+          loop_.resume();
         }
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
-        unifex::sync_wait(
-            run_.run_as_sender() |
-            unifex::stop_when(
-                unifex::schedule_after(time_.get_scheduler(), maxTime_)));
+        adapt(loop_.message_latency(), drained);
       }
     }) {}
+
+  // run queued tasks on the com thread until the queue is empty (returns
+  // true) or the deadline has passed (returns false). the clock is checked
+  // every budgetCheckInterval tasks rather than after each one. scheduling
+  // delays are measured against the same clock reads, so a task that runs
+  // between two reads is measured from the earlier one.
+  bool drain(clock_t::time_point now, clock_t::time_point deadline) noexcept {
+    std::size_t count = 0;
+    heartbeat_.tasksRun_.store(0, std::memory_order_relaxed);
+    heartbeat_.drainStart_.store(
+        now.time_since_epoch().count(), std::memory_order_release);
+    unifex::scope_guard record{[this, &count]() noexcept {
+      heartbeat_.drainStart_.store(0, std::memory_order_release);
+      drains_.add(1);
+      tasksRun_.add(count);
+      maxTasksPerDrain_.raise_to(count);
+    }};
+    for (;;) {
+      auto* next = pop_next();
+      if (!next) {
+        return true;
+      }
+      auto delay = now.time_since_epoch().count() - next->enqueued_;
+      if (delay > 0) {
+        maxScheduleDelay_.raise_to(std::uint64_t(delay));
+      }
+      heartbeat_.label_.store(next->label_, std::memory_order_relaxed);
+      next->execute_(next);
+      queueDepth_.sub(1);
+      heartbeat_.tasksRun_.store(++count, std::memory_order_relaxed);
+      if (count % budgetCheckInterval == 0) {
+        now = clock_t::now();
+        if (now >= deadline) {
+          // tasks in queues_ may have been coalesced onto the wakeup that
+          // started this drain, so take them before deciding. anything
+          // enqueued after the refill came after wakePending_ was cleared
+          // and has a wakeup of its own.
+          refill();
+          return std::all_of(ready_.begin(), ready_.end(), [](auto& lane) {
+            return lane.empty();
+          });
+        }
+      }
+    }
+  }
+
+  // move the tasks scheduled since the last refill into the empty lanes of
+  // ready_. a lane that still has work keeps its new tasks in queues_ so
+  // that they run after the ones already taken.
+  void refill() noexcept {
+    for (std::size_t lane = 0; lane < priorityCount; ++lane) {
+      if (ready_[lane].empty()) {
+        ready_[lane] = queues_[lane].dequeue_all();
+      }
+    }
+  }
+
+  // the next task in strict priority order, except that a lower lane that
+  // has been passed over starvationLimit times goes first
+  task* pop_next() noexcept {
+    refill();
+
+    auto chosen = priorityCount;
+    for (auto lane = priorityCount - 1; lane > 0; --lane) {
+      if (!ready_[lane].empty() && waited_[lane] >= starvationLimit) {
+        chosen = lane;
+        break;
+      }
+    }
+    for (std::size_t lane = 0; chosen == priorityCount && lane < priorityCount;
+         ++lane) {
+      if (!ready_[lane].empty()) {
+        chosen = lane;
+      }
+    }
+    if (chosen == priorityCount) {
+      return nullptr;
+    }
+
+    for (auto lane = chosen + 1; lane < priorityCount; ++lane) {
+      if (!ready_[lane].empty()) {
+        ++waited_[lane];
+      }
+    }
+    waited_[chosen] = 0;
+    return ready_[chosen].pop_front();
+  }
+
+  // halve the slice when messages are waiting too long, otherwise grow it
+  // by a quarter when work was left over
+  void adapt(duration_t messageLatency, bool drained) noexcept {
+    auto slice = current_slice();
+    if (messageLatency > bounds_.targetLatency_) {
+      slice /= 2;
+    } else if (!drained) {
+      slice += std::max<duration_t>(slice / 4, std::chrono::microseconds(100));
+    }
+    slice_.store(
+        std::clamp(slice, bounds_.min_, bounds_.max_).count(),
+        std::memory_order_relaxed);
+  }
+
+  void enqueue(task* t, priority p) noexcept {
+    t->enqueued_ = clock_t::now().time_since_epoch().count();
+    queueDepth_.add(1);
+    (void)queues_[static_cast<std::size_t>(p)].enqueue(t);
+    wake();
+  }
+
   struct make_sender {
-    using sender_t =
-        decltype(unifex::schedule(std::declval<run_scheduler_t&>()));
     com_thread* self_;
-    explicit make_sender(com_thread* self) : self_(self) {}
+    priority priority_;
+    const char* label_;
+    explicit make_sender(com_thread* self, priority p, const char* label)
+      : self_(self)
+      , priority_(p)
+      , label_(label) {}
     template <
         template <typename...>
         class Variant,
         template <typename...>
         class Tuple>
-    using value_types = unifex::sender_value_types_t<sender_t, Variant, Tuple>;
+    using value_types = Variant<Tuple<>>;
     template <template <typename...> class Variant>
-    using error_types = unifex::sender_error_types_t<sender_t, Variant>;
-    static inline constexpr bool sends_done = sender_t::sends_done;
+    using error_types = Variant<>;
+    static inline constexpr bool sends_done = true;
 
     template <typename Receiver>
     auto operator()(Receiver& rec) noexcept {
-      struct state {
-        using op_t = unifex::connect_result_t<sender_t, Receiver&>;
+      struct state : task {
         com_thread* self_;
-        op_t op_;
-        state(com_thread* self, sender_t sender, Receiver rec)
-          : self_(self)
-          , op_(unifex::connect(std::move(sender), rec)) {
-          unifex::start(op_);
-          // wake up the message loop
-          while (self_->comThread_.joinable() &&
-                 !PostThreadMessageW(
-                     GetThreadId(self_->comThread_.native_handle()),
-                     WM_USER,
-                     0,
-                     0L)) {
+        Receiver& rec_;
+
+        static void _execute(task* t) noexcept {
+          auto& self = *static_cast<state*>(t);
+          if constexpr (unifex::is_callable_v<
+                            unifex::tag_t<unifex::get_stop_token>,
+                            Receiver&>) {
+            if (unifex::get_stop_token(self.rec_).stop_requested()) {
+              unifex::set_done(std::move(self.rec_));
+              return;
+            }
           }
+          unifex::set_value(std::move(self.rec_));
+        }
+
+        state(
+            com_thread* self, priority p, const char* label, Receiver& rec)
+          : task{&_execute}
+          , self_(self)
+          , rec_(rec) {
+          label_ = label;
+          self_->enqueue(this, p);
         }
         state() = delete;
         state(const state&) = delete;
         state(state&&) = delete;
       };
 
-      return state{self_, unifex::schedule(self_->run_.get_scheduler()), rec};
+      return state{self_, priority_, label_, rec};
     }
   };
   struct _scheduler {
     com_thread* self_;
+    priority priority_;
+    const char* label_{nullptr};
     _scheduler() = delete;
-    explicit _scheduler(com_thread* self) : self_(self) {}
+    explicit _scheduler(com_thread* self, priority p)
+      : self_(self)
+      , priority_(p) {}
     _scheduler(const _scheduler&) = default;
     _scheduler(_scheduler&&) = default;
 
+    // the same scheduler, naming the tasks it schedules in stall reports.
+    // label must outlive the tasks.
+    _scheduler with_label(const char* label) const noexcept {
+      auto labelled = *this;
+      labelled.label_ = label;
+      return labelled;
+    }
+
     auto schedule() {
-      // return unifex::schedule(self_->run_.get_scheduler());
-      return unifex::create(make_sender{self_});
+      return unifex::create(make_sender{self_, priority_, label_});
     }
 
+    // the label does not change where or when the work runs
     friend bool operator==(_scheduler a, _scheduler b) noexcept {
-      return a.self_->run_.get_scheduler() == b.self_->run_.get_scheduler();
+      return a.self_ == b.self_ && a.priority_ == b.priority_;
     }
     friend bool operator!=(_scheduler a, _scheduler b) noexcept {
-      return a.self_->run_.get_scheduler() != b.self_->run_.get_scheduler();
+      return !(a == b);
     }
   };
-  _scheduler get_scheduler() { return _scheduler{this}; }
+  _scheduler get_scheduler(priority p = priority::normal) {
+    return _scheduler{this, p};
+  }
+
+  // how long queued work may hold off message dispatch right now
+  duration_t current_slice() const noexcept {
+    return duration_t{slice_.load(std::memory_order_relaxed)};
+  }
+
+  // number of tasks that have been scheduled and not yet run
+  std::size_t queue_depth() const noexcept {
+    return std::size_t(queueDepth_.load());
+  }
+
+  // number of times a drain ran out of time with work still queued
+  std::size_t budget_expirations() const noexcept {
+    return std::size_t(budgetExpirations_.load());
+  }
+
+  // the counters are always on. reading them does not disturb the loop.
+  stats snapshot() const noexcept {
+    return stats{
+        queueDepth_.load(),
+        drains_.load(),
+        tasksRun_.load(),
+        maxTasksPerDrain_.load(),
+        duration_t{duration_t::rep(dispatchTime_.load())},
+        duration_t{duration_t::rep(drainTime_.load())},
+        wakesPosted_.load(),
+        wakesCoalesced_.load(),
+        duration_t{duration_t::rep(maxScheduleDelay_.load())},
+        budgetExpirations_.load()};
+  }
+
+  // a failed wake is retried, backing off between attempts, for this long
+  // before the process terminates. the queue only stays full while the
+  // message loop is stuck, so this is long enough to ride out a burst.
+  static inline constexpr auto maxWakeWait = std::chrono::seconds(1);
+  static inline constexpr std::chrono::microseconds maxWakeBackoff{10000};
+
+  // wake up the message loop unless a wakeup is already on its way
+  void wake() noexcept {
+    if (wakePending_.exchange(true, std::memory_order_seq_cst)) {
+      wakesCoalesced_.add(1);
+      return;
+    }
+    wakesPosted_.add(1);
+    // posting fails until the com thread has created its message queue
+    started_.wait(false, std::memory_order_acquire);
+    // and when the queue is full
+    std::chrono::microseconds backoff{50};
+    clock_t::time_point deadline{};
+    for (int attempt = 1;; ++attempt) {
+      // a schedule() that comes after the loop has exited has nothing to
+      // wake, and its task is never run
+      if (exited_.load(std::memory_order_acquire)) {
+        return;
+      }
+      if (loop_.wake()) {
+        return;
+      }
+      if (attempt < 4) {
+        std::this_thread::yield();
+        continue;
+      }
+      auto now = clock_t::now();
+      if (attempt == 4) {
+        deadline = now + maxWakeWait;
+      } else if (now >= deadline) {
+        // the loop is running but has not taken a message for maxWakeWait
+        std::terminate();
+      }
+      std::this_thread::sleep_for(backoff);
+      backoff = std::min(backoff * 2, maxWakeBackoff);
+    }
+  }
 
   void join() {
     if (comThread_.joinable()) {
-      if (!PostThreadMessageW(
-              GetThreadId(comThread_.native_handle()), WM_QUIT, 0, 0L)) {
+      // quit can only be posted once the message queue exists
+      started_.wait(false, std::memory_order_acquire);
+      if (!loop_.quit()) {
         std::terminate();
       }
       try {
-        // there is a race in the windows thread implementation :(
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        if (comThread_.joinable()) {
-          comThread_.join();
-        }
+        // returns as soon as the loop has finished with the thread
+        exited_.wait(false, std::memory_order_acquire);
+        comThread_.join();
       } catch (...) {
       }
     }
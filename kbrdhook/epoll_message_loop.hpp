@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// com_thread event source for linux - an epoll set with an eventfd that
+// other threads write to wake the loop, and a timerfd the loop arms to come
+// back to its own queue.
+class epoll_message_loop {
+  int epoll_;
+  int wake_;
+  int timer_;
+  std::atomic<bool> quit_{false};
+  // when the pending wake was written (0 when none is pending)
+  std::atomic<std::chrono::steady_clock::rep> wakeTime_{0};
+  std::chrono::steady_clock::duration latency_{0};
+
+  void add(int fd) noexcept {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0) {
+      std::terminate();
+    }
+  }
+
+  // reset a readable eventfd or timerfd
+  static void consume(int fd) noexcept {
+    std::uint64_t count = 0;
+    while (read(fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+  }
+
+public:
+  // the descriptors are created up front so that other threads can wake the
+  // loop before the com thread has started
+  epoll_message_loop()
+    : epoll_(epoll_create1(EPOLL_CLOEXEC))
+    , wake_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    , timer_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) {
+    if (epoll_ < 0 || wake_ < 0 || timer_ < 0) {
+      std::terminate();
+    }
+    add(wake_);
+    add(timer_);
+  }
+  epoll_message_loop(epoll_message_loop&&) = delete;
+  ~epoll_message_loop() {
+    close(timer_);
+    close(wake_);
+    close(epoll_);
+  }
+
+  // called on the com thread before the loop starts
+  void attach() noexcept {}
+
+  // called on the com thread after the loop exits
+  void detach() noexcept {}
+
+  // block until woken or the timer fires. returns false when the loop has
+  // been asked to quit.
+  bool wait() noexcept {
+    epoll_event events[2];
+    int count = 0;
+    while ((count = epoll_wait(epoll_, events, 2, -1)) < 0) {
+      if (errno != EINTR) {
+        std::terminate();
+      }
+    }
+    for (int i = 0; i < count; ++i) {
+      consume(events[i].data.fd);
+    }
+    auto woken = wakeTime_.exchange(0, std::memory_order_relaxed);
+    latency_ = woken == 0
+        ? std::chrono::steady_clock::duration{0}
+        : std::chrono::steady_clock::now().time_since_epoch() -
+            std::chrono::steady_clock::duration{woken};
+    return !quit_.load(std::memory_order_acquire);
+  }
+
+  // how long the wake returned by the last wait() was pending
+  std::chrono::steady_clock::duration message_latency() const noexcept {
+    return latency_;
+  }
+
+  // there are no messages to dispatch, only wakes
+  std::chrono::steady_clock::duration dispatch_time() const noexcept {
+    return std::chrono::steady_clock::duration{0};
+  }
+
+  // wake the loop from any thread. (the eventfd counter collapses any
+  // number of wakes into one)
+  bool wake() noexcept {
+    auto expected = std::chrono::steady_clock::rep{0};
+    (void)wakeTime_.compare_exchange_strong(
+        expected,
+        std::chrono::steady_clock::now().time_since_epoch().count(),
+        std::memory_order_relaxed);
+    std::uint64_t one = 1;
+    ssize_t written = 0;
+    while ((written = write(wake_, &one, sizeof(one))) < 0 && errno == EINTR) {
+    }
+    // EAGAIN means the counter is saturated - the loop is already awake
+    return written == sizeof(one) || errno == EAGAIN;
+  }
+
+  // the time slice ended with work still queued. arm the timer so that the
+  // next wait() returns right away and the loop drains the rest.
+  void resume() noexcept {
+    itimerspec expiry = {};
+    expiry.it_value.tv_nsec = 1;
+    if (timerfd_settime(timer_, 0, &expiry, nullptr) != 0) {
+      std::terminate();
+    }
+  }
+
+  bool quit() noexcept {
+    quit_.store(true, std::memory_order_release);
+    return wake();
+  }
+};
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/just_from.hpp>
+
+#include "event_ring.hpp"
+#include "mapped_file.hpp"
+#include "sender_range.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <new>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// a binary log of timestamped events. the file is a header followed by
+// fixed size records:
+//
+//   header: "KBEL", version, record size, event size, record count
+//   record: nanoseconds since the log was opened (steady clock), event
+//
+// records are appended through a memory mapping of the whole capacity, and
+// the file is cut down to the records actually written on close. the reader
+// only trusts the record count, so a log that was never closed still reads.
+
+namespace detail {
+struct event_log_header {
+  char magic_[4];
+  std::uint32_t version_;
+  std::uint32_t recordSize_;
+  std::uint32_t eventSize_;
+  std::uint64_t count_;
+};
+inline constexpr std::uint32_t eventLogVersion = 1;
+}  // namespace detail
+
+template <typename EventType>
+struct event_log_record {
+  static_assert(std::is_trivially_copyable_v<EventType>);
+  std::uint64_t time_;
+  EventType event_;
+};
+
+// appends events to a log. append() may be called from any thread and never
+// blocks. events past the capacity are dropped and counted.
+//
+// when the file cannot be created and mapped the writer is not valid(), and
+// every event is dropped.
+//
+// the record count in the header is kept current, so a log survives a
+// crash of the writer. it then holds every record whose append() returned
+// (and possibly zeroed records for appends that were still running).
+template <typename EventType>
+class event_log_writer {
+  using record_t = event_log_record<EventType>;
+  using header_t = detail::event_log_header;
+  using clock_t = std::chrono::steady_clock;
+
+  std::uint64_t capacity_;
+  mapped_file file_;
+  clock_t::time_point origin_;
+  std::atomic<std::uint64_t> next_{0};
+  std::atomic<std::uint64_t> dropped_{0};
+
+  header_t* header() noexcept {
+    return reinterpret_cast<header_t*>(file_.writable_bytes().data());
+  }
+  record_t* records() noexcept {
+    return reinterpret_cast<record_t*>(
+        file_.writable_bytes().data() + sizeof(header_t));
+  }
+
+public:
+  event_log_writer(const std::filesystem::path& path, std::uint64_t capacity)
+    : capacity_(capacity)
+    , file_(path, sizeof(header_t) + capacity * sizeof(record_t))
+    , origin_(clock_t::now()) {
+    if (!valid()) {
+      capacity_ = 0;
+      return;
+    }
+    header_t header{
+        {'K', 'B', 'E', 'L'},
+        detail::eventLogVersion,
+        sizeof(record_t),
+        sizeof(EventType),
+        0};
+    std::memcpy(file_.writable_bytes().data(), &header, sizeof(header));
+  }
+  event_log_writer(const event_log_writer&) = delete;
+  // trims the file to the records written
+  ~event_log_writer() {
+    file_.truncate_on_close(sizeof(header_t) + written() * sizeof(record_t));
+  }
+
+  void append(const EventType& event) noexcept {
+    auto time = std::uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock_t::now() - origin_)
+            .count());
+    auto index = next_.fetch_add(1, std::memory_order_relaxed);
+    if (index >= capacity_) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    ::new (static_cast<void*>(records() + index)) record_t{time, event};
+    // the count only grows. an append that finishes before an earlier one
+    // covers that record too.
+    std::atomic_ref<std::uint64_t> count{header()->count_};
+    auto counted = count.load(std::memory_order_relaxed);
+    while (counted <= index &&
+           !count.compare_exchange_weak(
+               counted, index + 1, std::memory_order_release)) {
+    }
+  }
+
+  // false when the file could not be created and mapped
+  bool valid() const noexcept { return !file_.bytes().empty(); }
+
+  std::uint64_t written() const noexcept {
+    return std::min(next_.load(std::memory_order_relaxed), capacity_);
+  }
+  std::uint64_t dropped() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+};
+
+// the records of a log written by event_log_writer
+template <typename EventType>
+class event_log_reader {
+  using record_t = event_log_record<EventType>;
+  using header_t = detail::event_log_header;
+
+  mapped_file file_;
+  std::span<const record_t> records_;
+
+public:
+  explicit event_log_reader(const std::filesystem::path& path) : file_(path) {
+    auto bytes = file_.bytes();
+    header_t header{};
+    if (bytes.size() < sizeof(header)) {
+      return;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic_, "KBEL", 4) != 0 ||
+        header.version_ != detail::eventLogVersion ||
+        header.recordSize_ != sizeof(record_t) ||
+        header.eventSize_ != sizeof(EventType)) {
+      return;
+    }
+    auto available = (bytes.size() - sizeof(header)) / sizeof(record_t);
+    records_ = {
+        reinterpret_cast<const record_t*>(bytes.data() + sizeof(header)),
+        std::size_t(std::min<std::uint64_t>(header.count_, available))};
+  }
+
+  // empty when the file is missing or was written for another event type
+  std::span<const record_t> records() const noexcept { return records_; }
+};
+
+// the event function handed to the wrapped register function. it appends
+// each event to the log before passing it on.
+template <typename Fn, typename EventType>
+struct _recording_function {
+  Fn& fn_;
+  event_log_writer<EventType>* log_;
+
+  template <typename EventType2>
+  void operator()(EventType2&& event) {
+    if (!!log_) {
+      log_->append(event);
+    }
+    fn_((EventType2 &&) event);
+  }
+};
+
+// the registration of a recorded source. holds the recording function
+// that the wrapped registration refers to.
+template <typename Fn, typename EventType, typename RegisterFn>
+struct _recording_registration {
+  using function_t = _recording_function<Fn, EventType>;
+  using inner_t = std::invoke_result_t<RegisterFn&, function_t&>;
+
+  function_t fn_;
+  inner_t inner_;
+
+  _recording_registration(
+      Fn& fn, event_log_writer<EventType>* log, RegisterFn& registerFn)
+    : fn_{fn, log}
+    , inner_(registerFn(fn_)) {}
+  _recording_registration(const _recording_registration&) = delete;
+
+  // forward to the wrapped registration
+  auto start() { return inner_.start(); }
+  auto destroy() { return inner_.destroy(); }
+};
+
+namespace detail {
+// wrap a register/unregister function pair so that every event that the
+// source produces is also appended to log (when log is not null)
+template <typename EventType, typename RegisterFn, typename UnregisterFn>
+auto recorded_events(
+    std::pair<RegisterFn, UnregisterFn> fns,
+    event_log_writer<EventType>* log) {
+  auto register_ = [registerFn = std::move(fns.first),
+                    log](auto& fn) mutable noexcept {
+    return _recording_registration<
+        std::remove_reference_t<decltype(fn)>,
+        EventType,
+        RegisterFn>{fn, log, registerFn};
+  };
+  auto unregister_ = [unregisterFn = std::move(fns.second)](
+                         auto& registration) mutable noexcept {
+    unregisterFn(registration.inner_);
+  };
+  return std::make_pair(register_, unregister_);
+}
+}  // namespace detail
+
+// how a log is replayed
+enum class replay_timing {
+  // the gaps between events are the recorded gaps
+  original,
+  // as fast as the range takes them
+  as_fast_as_possible
+};
+
+// the registration of a replayed log. start() feeds the records to fn_ from
+// a thread of its own.
+template <typename Fn, typename EventType>
+struct _replay_source {
+  using clock_t = std::chrono::steady_clock;
+
+  Fn& fn_;
+  std::span<const event_log_record<EventType>> records_;
+  replay_timing timing_;
+  std::atomic<bool> stop_{false};
+  std::atomic<std::uint64_t> replayed_{0};
+  std::thread thread_;
+
+  _replay_source(
+      Fn& fn,
+      std::span<const event_log_record<EventType>> records,
+      replay_timing timing)
+    : fn_(fn)
+    , records_(records)
+    , timing_(timing) {}
+  ~_replay_source() {
+    if (thread_.joinable()) {
+      // must call destroy()
+      std::terminate();
+    }
+  }
+
+  void replay() noexcept {
+    using namespace std::literals::chrono_literals;
+    if (records_.empty()) {
+      return;
+    }
+    auto origin = clock_t::now();
+    auto first = records_.front().time_;
+    for (auto& record : records_) {
+      if (stop_.load(std::memory_order_relaxed)) {
+        return;
+      }
+      if (timing_ == replay_timing::original) {
+        auto due = origin + std::chrono::nanoseconds(record.time_ - first);
+        for (auto now = clock_t::now(); now < due; now = clock_t::now()) {
+          if (stop_.load(std::memory_order_relaxed)) {
+            return;
+          }
+          if (due - now > 200us) {
+            std::this_thread::sleep_for(
+                std::min<clock_t::duration>(due - now - 100us, 10ms));
+          } else {
+            std::this_thread::yield();
+          }
+        }
+      }
+      auto event = record.event_;
+      fn_(event);
+      replayed_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  [[nodiscard]] auto start() {
+    return unifex::just_from(
+        [this]() { thread_ = std::thread{[this]() noexcept { replay(); }}; });
+  }
+  [[nodiscard]] auto destroy() {
+    return unifex::just_from([this]() noexcept { stop(); });
+  }
+
+  void stop() noexcept {
+    stop_.store(true, std::memory_order_relaxed);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  std::uint64_t replayed() const noexcept {
+    return replayed_.load(std::memory_order_relaxed);
+  }
+  // every record has been handed to the range
+  bool finished() const noexcept { return replayed() == records_.size(); }
+};
+
+namespace detail {
+// the register and unregister functions for a sender_range fed from a log
+template <typename EventType>
+auto replayed_events(
+    std::span<const event_log_record<EventType>> records,
+    replay_timing timing) {
+  auto register_ = [records, timing](auto& fn) noexcept {
+    return _replay_source<std::remove_reference_t<decltype(fn)>, EventType>{
+        fn, records, timing};
+  };
+  auto unregister_ = [](auto& source) noexcept { source.stop(); };
+  return std::make_pair(register_, unregister_);
+}
+}  // namespace detail
+
+// a stand-in for keyboard_hook that replays a log
+template <typename EventType, std::size_t Capacity = 1024>
+class replay_event_source {
+  using fns = decltype(detail::replayed_events<EventType>(
+      std::declval<std::span<const event_log_record<EventType>>>(),
+      replay_timing::original));
+  using RangeType = sender_range<
+      EventType,
+      unifex::inplace_stop_token,
+      typename fns::first_type,
+      typename fns::second_type,
+      event_ring<EventType, Capacity>>;
+
+  event_log_reader<EventType> log_;
+  unifex::inplace_stop_source stopSource_;
+  RangeType range_;
+
+public:
+  // the log stays mapped for the lifetime of the source
+  explicit replay_event_source(
+      const std::filesystem::path& path,
+      replay_timing timing = replay_timing::original,
+      overflow_policy policy = overflow_policy::block)
+    : log_(path)
+    , range_(
+          stopSource_.get_token(),
+          policy,
+          detail::replayed_events<EventType>(log_.records(), timing).first,
+          detail::replayed_events<EventType>(log_.records(), timing).second) {}
+
+  unifex::inplace_stop_source& get_stop_source() { return stopSource_; }
+  void request_stop() { stopSource_.request_stop(); }
+
+  [[nodiscard]] auto start() { return range_.get_registration()->start(); }
+  // stops the range, which releases a replay thread blocked on a full
+  // buffer (the consumer may already be gone) before joining it
+  [[nodiscard]] auto destroy() {
+    return unifex::just_from([this]() noexcept { request_stop(); });
+  }
+
+  auto events() { return range_.view(); }
+  auto batches() { return range_.batches(); }
+
+  std::size_t size() const noexcept { return log_.records().size(); }
+  bool finished() noexcept {
+    auto& registration = range_.get_registration();
+    return !registration || registration->finished();
+  }
+  std::size_t queued_events() const noexcept { return range_.queued_events(); }
+  std::size_t dropped_events() const noexcept {
+    return range_.dropped_events();
+  }
+};
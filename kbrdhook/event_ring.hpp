@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <thread>
+#include <type_traits>
+
+// what to do with an event that arrives while the buffer is full
+enum class overflow_policy {
+  // discard the oldest buffered event to make room for the new one
+  drop_oldest,
+  // discard the new event
+  drop_newest,
+  // wait in the producer until the consumer makes room (the consumer must
+  // not be running on the producer thread)
+  block
+};
+
+// used as the buffer of a sender_range that discards events that arrive
+// while no sender is pending
+struct no_event_buffer {
+  static inline constexpr std::size_t capacity = 0;
+};
+
+// fixed-capacity lock-free ring that holds events until a sender is ready
+// to take them. any number of threads may push and pop concurrently.
+//
+// each cell carries a sequence number that tells producers and consumers
+// whether the cell is free or holds a published event for the position
+// they are trying to claim (bounded mpmc queue by Dmitry Vyukov)
+template <typename EventType, std::size_t Capacity>
+class event_ring {
+  static_assert(
+      Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+      "event_ring Capacity must be a power of two");
+  static_assert(
+      std::is_default_constructible_v<EventType> &&
+          std::is_nothrow_move_constructible_v<EventType> &&
+          std::is_nothrow_move_assignable_v<EventType>,
+      "event_ring requires events that can be moved in and out of a cell "
+      "without throwing");
+
+  static inline constexpr std::size_t mask_ = Capacity - 1;
+
+  struct cell {
+    std::atomic<std::size_t> sequence_;
+    EventType event_;
+  };
+
+  // keep producers and consumers from sharing a cache line
+  alignas(64) std::atomic<std::size_t> enqueuePos_{0};
+  alignas(64) std::atomic<std::size_t> dequeuePos_{0};
+  alignas(64) std::atomic<std::size_t> queued_{0};
+  std::atomic<std::size_t> dropped_{0};
+  std::atomic<bool> closed_{false};
+  overflow_policy policy_;
+  std::array<cell, Capacity> cells_;
+
+public:
+  static inline constexpr std::size_t capacity = Capacity;
+
+  explicit event_ring(overflow_policy policy = overflow_policy::drop_oldest)
+    : policy_(policy) {
+    for (std::size_t i = 0; i < Capacity; ++i) {
+      cells_[i].sequence_.store(i, std::memory_order_relaxed);
+    }
+  }
+  event_ring(event_ring&&) = delete;
+
+  overflow_policy policy() const noexcept { return policy_; }
+
+  // the consumer has gone. producers blocked by overflow_policy::block
+  // give up and discard their events, and so do later pushes that find
+  // the ring full.
+  void close() noexcept { closed_.store(true, std::memory_order_release); }
+  bool closed() const noexcept {
+    return closed_.load(std::memory_order_acquire);
+  }
+
+  // total number of events that have been stored in the ring
+  std::size_t queued_count() const noexcept {
+    return queued_.load(std::memory_order_relaxed);
+  }
+  // total number of events that were discarded by the overflow policy
+  std::size_t dropped_count() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+  // approximate number of events in the ring right now
+  std::size_t size() const noexcept {
+    auto enqueued = enqueuePos_.load(std::memory_order_relaxed);
+    auto dequeued = dequeuePos_.load(std::memory_order_relaxed);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+  }
+
+  // true when the oldest event has been published and can be popped.
+  // (an event that a producer has claimed a cell for, but not yet finished
+  // writing, is not ready - that producer will observe the pending sender
+  // after it publishes)
+  bool ready() const noexcept {
+    auto pos = dequeuePos_.load(std::memory_order_relaxed);
+    auto& c = cells_[pos & mask_];
+    return c.sequence_.load(std::memory_order_acquire) == pos + 1;
+  }
+
+  bool try_push(EventType& event) noexcept {
+    auto pos = enqueuePos_.load(std::memory_order_relaxed);
+    cell* c = nullptr;
+    for (;;) {
+      c = &cells_[pos & mask_];
+      auto seq = c->sequence_.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(seq) -
+          static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueuePos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // full
+        return false;
+      } else {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    c->event_ = std::move(event);
+    c->sequence_.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  std::optional<EventType> try_pop() noexcept {
+    auto pos = dequeuePos_.load(std::memory_order_relaxed);
+    cell* c = nullptr;
+    for (;;) {
+      c = &cells_[pos & mask_];
+      auto seq = c->sequence_.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(seq) -
+          static_cast<std::intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeuePos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // empty
+        return std::nullopt;
+      } else {
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    std::optional<EventType> result{std::move(c->event_)};
+    c->sequence_.store(pos + mask_ + 1, std::memory_order_release);
+    return result;
+  }
+
+  // move as many published events as fit into the batch and return the
+  // number of events moved
+  std::size_t pop_into(std::span<EventType> batch) noexcept {
+    std::size_t count = 0;
+    while (count < batch.size()) {
+      auto event = try_pop();
+      if (!event) {
+        break;
+      }
+      batch[count++] = std::move(event.value());
+    }
+    return count;
+  }
+
+  // store the event, applying the overflow policy when the ring is full.
+  // returns false if the new event was discarded (including a blocked push
+  // that was released by close()).
+  bool push(EventType event) noexcept {
+    for (;;) {
+      if (try_push(event)) {
+        queued_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+      switch (policy_) {
+        case overflow_policy::drop_newest:
+          dropped_.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        case overflow_policy::drop_oldest:
+          if (!!try_pop()) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+          }
+          break;
+        case overflow_policy::block:
+          if (closed()) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+          }
+          std::this_thread::yield();
+          break;
+      }
+    }
+  }
+};
@@ -30,20 +30,35 @@
 
 #include <cassert>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <optional>
+#include <variant>
 
 #include "clean_stop.hpp"
 #include "com_thread.hpp"
+#include "event_log.hpp"
 #include "keyboard_hook.hpp"
+#include "merged_range.hpp"
 #include "player.hpp"
+#include "trace.hpp"
+#include "watchdog.hpp"
 
-unifex::task<void> clickety(Player& player, keyboard_hook& keyboard) {
-  for (auto next : keyboard.events()) {
-    auto evt = co_await unifex::done_as_optional(std::move(next));
-    if (!evt) {
+template <typename Inputs>
+unifex::task<void> clickety(Player& player, Inputs& inputs) {
+  // one resume handles every keystroke that arrived on one of the inputs
+  // since the last one
+  for (auto next : inputs) {
+    auto batch = co_await unifex::done_as_optional(std::move(next));
+    if (!batch) {
       break;
     }
-    player.Click();
+    // every input delivers a span of key_event
+    auto events = std::visit([](auto events) { return events; }, *batch);
+    for (auto evt : events) {
+      KBRDHOOK_TRACE(trace_stage::resume, evt);
+      player.Click(evt);
+    }
   }
 
   co_return;
@@ -56,20 +71,46 @@ int wmain() {
   }};
   using namespace std::literals::chrono_literals;
 
-  com_thread com{50ms};
+  // input dispatch gets a turn at least every 50ms, more often when
+  // messages start to wait
+  com_thread com{com_thread::adaptive_slice{5ms, 50ms, 10ms}};
+  // the OS removes a low level keyboard hook that does not return in time
+  com_thread_watchdog watchdog{com, 200ms};
   clean_stop exit{com.get_scheduler()};
-  Player player{com.get_scheduler()};
-  keyboard_hook keyboard{com.get_scheduler()};
+  Player player{
+      com.get_scheduler(), com.get_scheduler(com_thread::priority::high)};
+  // KBRDHOOK_RECORD=<path> records the keystrokes for replay_event_source
+  std::optional<event_log_writer<key_event>> log;
+  if (const char* path = std::getenv("KBRDHOOK_RECORD")) {
+    log.emplace(path, 1u << 20);
+    if (!log->valid()) {
+      fprintf(
+          stderr, "cannot record to %s, running without recording\n", path);
+      log.reset();
+    }
+  }
+  keyboard_hook keyboard{com.get_scheduler(), log ? &*log : nullptr};
+  // KBRDHOOK_REPLAY=<path> plays a recorded log along with the keyboard
+  const char* replayPath = std::getenv("KBRDHOOK_REPLAY");
+  replay_event_source<key_event> replay{replayPath ? replayPath : ""};
+  auto inputs = merge(keyboard.batches(), replay.batches());
 
   unifex::sync_wait(unifex::sequence(
       // start
-      unifex::sequence(exit.start(), player.start(), keyboard.start()),
+      unifex::sequence(
+          exit.start(), player.start(), keyboard.start(), replay.start()),
       unifex::just_from([]() { printf("press ctrl-C to stop...\n"); }),
       // click
-      clickety(player, keyboard) |
+      clickety(player, inputs) |
           unifex::stop_when(
               // until ctrl+C
               exit.event()),
       // stop
-      unifex::sequence(keyboard.destroy(), player.destroy(), exit.destroy())));
+      unifex::sequence(
+          replay.destroy(),
+          keyboard.destroy(),
+          player.destroy(),
+          exit.destroy())));
+
+  KBRDHOOK_TRACE_DUMP(stdout);
 }
\ No newline at end of file
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "trace.hpp"
+
+#include <cstdint>
+
+// one keystroke. message_ is the WM_KEYDOWN/WM_SYSKEYDOWN message and
+// vkCode_ the virtual-key code from KBDLLHOOKSTRUCT.
+struct key_event {
+  std::uint32_t message_{0};
+  std::uint32_t vkCode_{0};
+#if defined(KBRDHOOK_ENABLE_TRACING)
+  trace_stamp trace_{};
+#endif
+
+  // the same key, ignoring when it was pressed
+  friend bool operator==(const key_event& a, const key_event& b) noexcept {
+    return a.message_ == b.message_ && a.vkCode_ == b.vkCode_;
+  }
+};
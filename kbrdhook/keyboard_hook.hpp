@@ -22,14 +22,17 @@
 #include <unifex/sender_concepts.hpp>
 #include <unifex/sequence.hpp>
 
-#include "sender_range.hpp"
 #include "com_thread.hpp"
+#include "event_log.hpp"
+#include "key_event.hpp"
+#include "sender_range.hpp"
 
 #include <windows.h>
 #include <windowsx.h>
 #include <winuser.h>
 
 #include <atomic>
+#include <cstdint>
 
 template <typename Fn>
 struct _keyboard_hook {
@@ -105,7 +108,10 @@ struct _keyboard_hook {
     _keyboard_hook* self = self_.load();
     if (!!self && nCode >= 0 &&
         (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN)) {
-      self->fn_(wParam);
+      const auto* info = reinterpret_cast<const KBDLLHOOKSTRUCT*>(lParam);
+      key_event event{static_cast<std::uint32_t>(wParam), info->vkCode};
+      KBRDHOOK_TRACE_BEGIN(event);
+      self->fn_(event);
       return CallNextHookEx(self->hHook_, nCode, wParam, lParam);
     }
     return CallNextHookEx(NULL, nCode, wParam, lParam);
@@ -129,22 +135,30 @@ auto keyboard_events(Scheduler uiLoop) {
 class keyboard_hook {
   using scheduler_t =
       decltype(std::declval<com_thread>().get_scheduler());
-  using fns = decltype(detail::keyboard_events(std::declval<scheduler_t&>()));
+  using fns = decltype(detail::recorded_events<key_event>(
+      detail::keyboard_events(std::declval<scheduler_t&>()), nullptr));
+  // keystrokes that arrive while clickety is busy are held until it asks
+  // for the next one
   using RangeType = sender_range<
-      WPARAM,
+      key_event,
       unifex::inplace_stop_token,
       typename fns::first_type,
-      typename fns::second_type>;
+      typename fns::second_type,
+      event_ring<key_event, 64>>;
 
   unifex::inplace_stop_source stopSource_;
   RangeType range_;
 
 public:
-  explicit keyboard_hook(scheduler_t uiLoop)
+  // when log is not null every keystroke is also appended to it
+  explicit keyboard_hook(
+      scheduler_t uiLoop, event_log_writer<key_event>* log = nullptr)
     : range_(
           stopSource_.get_token(),
-          detail::keyboard_events(uiLoop).first,
-          detail::keyboard_events(uiLoop).second) {}
+          overflow_policy::drop_oldest,
+          detail::recorded_events(detail::keyboard_events(uiLoop), log).first,
+          detail::recorded_events(detail::keyboard_events(uiLoop), log)
+              .second) {}
 
   unifex::inplace_stop_source& get_stop_source() { return stopSource_; }
   void request_stop() { stopSource_.request_stop(); }
@@ -153,4 +167,10 @@ public:
   [[nodiscard]] auto destroy() { return range_.get_registration()->destroy(); }
 
   auto events() { return range_.view(); }
+  auto batches() { return range_.batches(); }
+
+  std::size_t queued_events() const noexcept { return range_.queued_events(); }
+  std::size_t dropped_events() const noexcept {
+    return range_.dropped_events();
+  }
 };
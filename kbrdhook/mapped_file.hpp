@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+// a view of a whole file, either read-only or, for a file created with a
+// fixed size, writable
+class mapped_file {
+  std::uint8_t* data_{nullptr};
+  std::size_t size_{0};
+  bool writable_{false};
+  // a writable file is cut down to this size when it is closed
+  std::size_t finalSize_{0};
+#if defined(_WIN32)
+  HANDLE file_{INVALID_HANDLE_VALUE};
+  HANDLE mapping_{NULL};
+#else
+  // only kept open for a writable file
+  int fd_{-1};
+#endif
+
+public:
+  explicit mapped_file(const std::filesystem::path& path) {
+#if defined(_WIN32)
+    file_ = CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+    LARGE_INTEGER size{};
+    if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) ||
+        size.QuadPart == 0) {
+      return;
+    }
+    mapping_ = CreateFileMappingW(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping_) {
+      return;
+    }
+    auto* view = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    if (!!view) {
+      data_ = static_cast<std::uint8_t*>(view);
+      size_ = static_cast<std::size_t>(size.QuadPart);
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info {};
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+      auto* view = ::mmap(
+          nullptr, std::size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if (view != MAP_FAILED) {
+        data_ = static_cast<std::uint8_t*>(view);
+        size_ = std::size_t(info.st_size);
+      }
+    }
+    // the mapping keeps the file alive
+    ::close(fd);
+#endif
+  }
+  // creates (or replaces) the file at path with size zeroed bytes, mapped
+  // for writing. writes reach the file even if the process crashes.
+  mapped_file(const std::filesystem::path& path, std::size_t size)
+    : writable_(true) {
+#if defined(_WIN32)
+    file_ = CreateFileW(
+        path.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ,
+        NULL,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+    if (file_ == INVALID_HANDLE_VALUE || size == 0) {
+      return;
+    }
+    ULARGE_INTEGER mappedSize;
+    mappedSize.QuadPart = size;
+    mapping_ = CreateFileMappingW(
+        file_,
+        NULL,
+        PAGE_READWRITE,
+        mappedSize.HighPart,
+        mappedSize.LowPart,
+        NULL);
+    if (!mapping_) {
+      return;
+    }
+    auto* view = MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, size);
+    if (!!view) {
+      data_ = static_cast<std::uint8_t*>(view);
+      size_ = size;
+      finalSize_ = size;
+    }
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0 || size == 0 || ::ftruncate(fd_, off_t(size)) != 0) {
+      return;
+    }
+    auto* view =
+        ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (view != MAP_FAILED) {
+      data_ = static_cast<std::uint8_t*>(view);
+      size_ = size;
+      finalSize_ = size;
+    }
+#endif
+  }
+  mapped_file(const mapped_file&) = delete;
+  ~mapped_file() {
+#if defined(_WIN32)
+    if (!!data_) {
+      if (writable_) {
+        FlushViewOfFile(data_, 0);
+      }
+      UnmapViewOfFile(data_);
+    }
+    if (!!mapping_) {
+      CloseHandle(mapping_);
+    }
+    if (file_ != INVALID_HANDLE_VALUE) {
+      if (writable_ && finalSize_ != size_) {
+        LARGE_INTEGER end;
+        end.QuadPart = LONGLONG(finalSize_);
+        SetFilePointerEx(file_, end, NULL, FILE_BEGIN);
+        SetEndOfFile(file_);
+      }
+      CloseHandle(file_);
+    }
+#else
+    if (!!data_) {
+      ::munmap(data_, size_);
+    }
+    if (fd_ >= 0) {
+      if (finalSize_ != size_) {
+        (void)::ftruncate(fd_, off_t(finalSize_));
+      }
+      ::close(fd_);
+    }
+#endif
+  }
+
+  std::span<const std::uint8_t> bytes() const noexcept {
+    return {data_, size_};
+  }
+  // empty unless the file was created writable and mapped
+  std::span<std::uint8_t> writable_bytes() noexcept {
+    return writable_ ? std::span<std::uint8_t>{data_, size_}
+                     : std::span<std::uint8_t>{};
+  }
+
+  // a writable file keeps only its first size bytes when it is closed
+  void truncate_on_close(std::size_t size) noexcept {
+    finalSize_ = std::min(size, size_);
+  }
+};
@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <unifex/detail/atomic_intrusive_queue.hpp>
+#include <unifex/detail/intrusive_queue.hpp>
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/receiver_concepts.hpp>
+#include <unifex/sender_concepts.hpp>
+#include <unifex/stop_token_concepts.hpp>
+
+#include "range_adaptors.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <ranges>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+// merge(sources...) interleaves the events from several ranges of senders
+// (sender_range::view(), batches(), an adaptor) into one range. each
+// sender completes with a std::variant whose index() is the source of the
+// event.
+//
+// every source has one slot that holds its pending sender and, once that
+// completes, its event until the consumer takes it. a slot is started
+// again when the next merged sender starts, so the event (or batch) is
+// valid until then and the sources keep buffering while the consumer is
+// busy. no allocation is made per event.
+//
+// like sender_range, only one sender from a merged range may be started at
+// a time. a source that completes with done has ended, the merged range
+// ends when every source has ended. the sources are views, so the ranges
+// (and adaptors) they refer to must outlive the merged range.
+
+template <typename... Sources>
+class merged_range {
+public:
+  using event_t = std::variant<detail::range_event_t<Sources>...>;
+
+private:
+  static inline constexpr std::size_t sourceCount = sizeof...(Sources);
+  static inline constexpr std::size_t noSource = sourceCount;
+
+  // a slot whose sender has completed
+  struct ready_node {
+    std::size_t index_;
+    ready_node* next_{nullptr};
+  };
+
+  // the merged sender waiting for a slot to complete
+  struct waiter {
+    void (*resume_)(waiter*) noexcept;
+  };
+
+  template <std::size_t Index>
+  struct source_slot : ready_node {
+    using source_t = std::tuple_element_t<Index, std::tuple<Sources...>>;
+    using iterator_t = decltype(std::declval<source_t&>().begin());
+    using sender_t = std::decay_t<decltype(*std::declval<iterator_t&>())>;
+    using slot_event_t = detail::range_event_t<source_t>;
+
+    // receives the result of the slot's sender
+    struct child_receiver {
+      merged_range* range_;
+      source_slot* slot_;
+
+      template <typename... Values>
+      void set_value(Values&&... values) noexcept {
+        slot_->event_.emplace((Values &&) values...);
+        range_->child_complete(slot_);
+      }
+      void set_done() noexcept { range_->child_complete(slot_); }
+      template <typename Error>
+      void set_error(Error&& error) noexcept {
+        if constexpr (std::is_same_v<
+                          std::decay_t<Error>,
+                          std::exception_ptr>) {
+          slot_->error_ = (Error &&) error;
+        } else {
+          slot_->error_ = std::make_exception_ptr((Error &&) error);
+        }
+        range_->child_complete(slot_);
+      }
+
+      unifex::inplace_stop_token stop_token() const noexcept {
+        return range_->stopSource_.get_token();
+      }
+
+      // the slots outlive the merged senders, so they are only cancelled
+      // when the merged range is destroyed
+      friend unifex::inplace_stop_token tag_invoke(
+          unifex::tag_t<unifex::get_stop_token>,
+          const child_receiver& r) noexcept {
+        return r.stop_token();
+      }
+    };
+    using op_t = unifex::connect_result_t<sender_t, child_receiver>;
+
+    source_t source_;
+    iterator_t next_;
+    std::optional<op_t> op_;
+    // the result of the last sender. neither is set after done.
+    std::optional<slot_event_t> event_;
+    std::exception_ptr error_;
+
+    explicit source_slot(source_t source)
+      : ready_node{Index}
+      , source_(std::move(source))
+      , next_(source_.begin()) {}
+    source_slot(source_slot&&) = delete;
+
+    void start(merged_range* range) noexcept {
+      // the last sender has completed, and is only ever destroyed after it
+      // called its receiver
+      op_.reset();
+      range->running_.fetch_add(1, std::memory_order_relaxed);
+      op_.emplace(detail::_conv{[&]() {
+        auto sender = *next_;
+        ++next_;
+        return unifex::connect(std::move(sender), child_receiver{range, this});
+      }});
+      unifex::start(*op_);
+    }
+  };
+
+  template <std::size_t... Indices>
+  static auto make_slots(std::index_sequence<Indices...>)
+      -> std::tuple<source_slot<Indices>...>;
+  using slots_t =
+      decltype(make_slots(std::make_index_sequence<sourceCount>{}));
+
+  // cancels the slots when the merged range is destroyed
+  unifex::inplace_stop_source stopSource_;
+  slots_t slots_;
+  // slots that have completed, in the order they completed
+  unifex::atomic_intrusive_queue<ready_node, &ready_node::next_> completed_;
+  std::atomic<waiter*> waiting_{nullptr};
+  // slots whose sender has not completed yet
+  std::atomic<std::size_t> running_{0};
+  // set by the stop callback of the running merged sender. once that
+  // sender is in waiting_ it may be destroyed by another thread, so next()
+  // reads this instead of its stop token.
+  std::atomic<bool> stopRequested_{false};
+
+  // the rest is only used by the merged sender that is running
+  unifex::intrusive_queue<ready_node, &ready_node::next_> ready_;
+  bool started_{false};
+  // the slot that emitted the last event, started by the next sender
+  std::size_t restart_{noSource};
+  std::size_t ended_{0};
+
+  template <typename Fn>
+  void for_slot(std::size_t index, Fn&& fn) noexcept {
+    [&]<std::size_t... Indices>(std::index_sequence<Indices...>) {
+      ((index == Indices ? (void)fn(std::get<Indices>(slots_)) : void()),
+       ...);
+    }
+    (std::make_index_sequence<sourceCount>{});
+  }
+
+  // puts the slot on the completed queue and takes the waiting merged
+  // sender, if there is one
+  waiter* publish(ready_node* node) noexcept {
+    (void)completed_.enqueue(node);
+    // pairs with the fence in next()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return waiting_.exchange(nullptr, std::memory_order_acq_rel);
+  }
+
+  template <std::size_t Index>
+  void child_complete(source_slot<Index>* slot) noexcept {
+    if (stopSource_.stop_requested()) {
+      // the merged range is being destroyed
+      running_.fetch_sub(1, std::memory_order_release);
+      return;
+    }
+    auto* w = publish(slot);
+    // the merged range may be destroyed once running_ is 0, unless this
+    // thread now runs the merged sender
+    running_.fetch_sub(1, std::memory_order_release);
+    if (!!w) {
+      w->resume_(w);
+    }
+  }
+
+  // hand the result of a slot to the merged sender. returns false when the
+  // slot has ended and the sender is still waiting.
+  template <typename State, std::size_t Index>
+  bool take(State* state, source_slot<Index>& slot) noexcept {
+    if (!!slot.error_) {
+      ++ended_;
+      state->complete_error(std::exchange(slot.error_, nullptr));
+      return true;
+    }
+    if (!slot.event_) {
+      ++ended_;
+      return false;
+    }
+    event_t event{std::in_place_index<Index>, std::move(*slot.event_)};
+    slot.event_.reset();
+    restart_ = Index;
+    state->complete_value(std::move(event));
+    return true;
+  }
+
+  template <typename State>
+  void start(State* state) noexcept {
+    if (!std::exchange(started_, true)) {
+      std::apply([this](auto&... slot) { (slot.start(this), ...); }, slots_);
+    } else if (restart_ != noSource) {
+      for_slot(std::exchange(restart_, noSource), [this](auto& slot) {
+        slot.start(this);
+      });
+    }
+    next(state);
+  }
+
+  // complete the merged sender with the next slot, or leave it in
+  // waiting_ for the next slot to complete
+  template <typename State>
+  void next(State* state) noexcept {
+    for (;;) {
+      if (state->stopToken_.stop_requested()) {
+        state->complete_done();
+        return;
+      }
+      if (ready_.empty()) {
+        ready_ = completed_.dequeue_all();
+      }
+      while (!ready_.empty()) {
+        auto* node = ready_.pop_front();
+        bool taken = false;
+        for_slot(node->index_, [&](auto& slot) {
+          taken = take(state, slot);
+        });
+        if (taken) {
+          return;
+        }
+      }
+      if (ended_ == sourceCount) {
+        state->complete_done();
+        return;
+      }
+
+      waiting_.store(state, std::memory_order_release);
+      // a slot that completes or a stop request after this point sees
+      // waiting_ and resumes the sender. state is not touched again unless
+      // it is taken back out of waiting_.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      auto late = completed_.dequeue_all();
+      if (late.empty() && !stopRequested_.load(std::memory_order_relaxed)) {
+        return;
+      }
+      if (waiting_.exchange(nullptr, std::memory_order_acq_rel) != state) {
+        // a slot or the stop callback took the sender and resumes it. put
+        // the slots back for it.
+        while (!late.empty()) {
+          if (auto* w = publish(late.pop_front())) {
+            w->resume_(w);
+          }
+        }
+        return;
+      }
+      ready_ = std::move(late);
+    }
+  }
+
+  struct make_sender {
+    template <
+        template <typename...>
+        class Variant,
+        template <typename...>
+        class Tuple>
+    using value_types = Variant<Tuple<event_t>>;
+
+    template <template <typename...> class Variant>
+    using error_types = Variant<std::exception_ptr>;
+
+    static inline constexpr bool sends_done = true;
+
+    template <typename Receiver>
+    struct state : waiter {
+      using stop_token_t =
+          decltype(detail::_stop_token_of(std::declval<Receiver&>()));
+
+      // cancellation of a waiting sender. the slots keep running.
+      struct stop_callback {
+        state* state_;
+        void operator()() noexcept {
+          auto* range = state_->range_;
+          range->stopRequested_.store(true, std::memory_order_relaxed);
+          // pairs with the fence in next()
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          if (range->waiting_.exchange(nullptr, std::memory_order_acq_rel) ==
+              state_) {
+            state_->complete_done();
+          }
+        }
+      };
+
+      merged_range* range_;
+      Receiver& rec_;
+      stop_token_t stopToken_;
+      std::optional<
+          typename stop_token_t::template callback_type<stop_callback>>
+          callback_;
+
+      static void _resume(waiter* self) noexcept {
+        auto* s = static_cast<state*>(self);
+        s->range_->next(s);
+      }
+
+      state(merged_range* range, Receiver& rec)
+        : waiter{&_resume}
+        , range_(range)
+        , rec_(rec)
+        , stopToken_(detail::_stop_token_of(rec)) {
+        // the callback of the last sender was removed before it completed
+        range_->stopRequested_.store(false, std::memory_order_relaxed);
+        callback_.emplace(stopToken_, stop_callback{this});
+        range_->start(this);
+      }
+      state(state&&) = delete;
+
+      // completing the receiver may destroy this state, so it is the last
+      // thing done
+      void complete_value(event_t&& event) noexcept {
+        callback_.reset();
+        unifex::set_value(std::move(rec_), std::move(event));
+      }
+      void complete_error(std::exception_ptr error) noexcept {
+        callback_.reset();
+        unifex::set_error(std::move(rec_), std::move(error));
+      }
+      void complete_done() noexcept {
+        callback_.reset();
+        unifex::set_done(std::move(rec_));
+      }
+    };
+
+    template <typename Receiver>
+    state<Receiver> operator()(Receiver& rec, merged_range* range) noexcept {
+      return {range, rec};
+    }
+  };
+
+  static auto make_range(merged_range* self) {
+    return std::views::iota(0) | std::views::transform([self](int) {
+             return unifex::create(make_sender{}, self);
+           });
+  }
+  using RangeType = decltype(make_range(nullptr));
+  RangeType range_;
+
+  struct sender_view {
+    RangeType* range_;
+
+    auto begin() { return range_->begin(); }
+    auto end() { return range_->end(); }
+  };
+
+public:
+  explicit merged_range(Sources... sources)
+    : slots_(std::move(sources)...)
+    , range_(make_range(this)) {}
+  merged_range(merged_range&&) = delete;
+  ~merged_range() {
+    // no merged sender is running. cancel the slots and wait until they
+    // have completed. a slot must not touch the range after its decrement,
+    // so this yields instead of waiting for a notification.
+    stopSource_.request_stop();
+    while (running_.load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  auto view() { return sender_view{&range_}; }
+
+  auto begin() noexcept { return range_.begin(); }
+  auto end() noexcept { return range_.end(); }
+};
+
+// one range of the events from all of the sources, tagged with the index
+// of their source
+template <typename... Sources>
+requires(sizeof...(Sources) > 0)
+auto merge(Sources... sources) {
+  return merged_range<Sources...>{std::move(sources)...};
+}
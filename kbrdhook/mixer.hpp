@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "event_ring.hpp"
+#include "pcm_kernels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <span>
+
+// a request to start playing a sample
+struct voice_trigger {
+  const float* samples_{nullptr};
+  std::size_t frames_{0};
+  float gain_{1.0f};
+};
+
+// sums pre-decoded mono float PCM from a fixed pool of voices, so that
+// overlapping clicks play over each other instead of cutting each other off.
+//
+// trigger() may be called from any thread and only writes one slot of a
+// lock-free ring. render() is called from the audio thread. it starts the
+// triggered voices, stealing the voice that has played the longest when all
+// of them are busy.
+//
+// the samples passed to trigger() must outlive the mixer.
+template <std::size_t Voices, std::size_t PendingTriggers = 64>
+class mixer {
+  struct voice {
+    const float* samples_{nullptr};
+    std::size_t frames_{0};
+    std::size_t position_{0};
+    float gain_{0.0f};
+  };
+
+  event_ring<voice_trigger, PendingTriggers> triggers_{
+      overflow_policy::drop_oldest};
+  // only touched by render()
+  std::array<voice, Voices> voices_{};
+  const pcm_kernels& kernels_ = active_pcm_kernels();
+  std::atomic<std::size_t> active_{0};
+  std::atomic<std::size_t> stolen_{0};
+
+  void start_voice(const voice_trigger& trigger) noexcept {
+    voice* target = &voices_[0];
+    for (auto& v : voices_) {
+      if (!v.samples_) {
+        target = &v;
+        break;
+      }
+      if (v.position_ > target->position_) {
+        target = &v;
+      }
+    }
+    if (!!target->samples_) {
+      stolen_.fetch_add(1, std::memory_order_relaxed);
+    }
+    *target = voice{trigger.samples_, trigger.frames_, 0, trigger.gain_};
+  }
+
+public:
+  static inline constexpr std::size_t voice_count = Voices;
+
+  // when more than PendingTriggers arrive between two renders the oldest are
+  // dropped
+  void trigger(std::span<const float> sample, float gain = 1.0f) noexcept {
+    (void)triggers_.push(voice_trigger{sample.data(), sample.size(), gain});
+  }
+
+  // overwrite out with the sum of the active voices
+  void render(std::span<float> out) noexcept {
+    while (auto trigger = triggers_.try_pop()) {
+      start_voice(trigger.value());
+    }
+
+    std::fill(out.begin(), out.end(), 0.0f);
+    std::size_t active = 0;
+    for (auto& v : voices_) {
+      if (!v.samples_) {
+        continue;
+      }
+      auto count = std::min(out.size(), v.frames_ - v.position_);
+      kernels_.mix_f32(out.data(), v.samples_ + v.position_, v.gain_, count);
+      v.position_ += count;
+      if (v.position_ == v.frames_) {
+        v = voice{};
+      } else {
+        ++active;
+      }
+    }
+    active_.store(active, std::memory_order_relaxed);
+  }
+
+  // voices still playing after the last render()
+  std::size_t active_voices() const noexcept {
+    return active_.load(std::memory_order_relaxed);
+  }
+  // voices cut off to make room for a new trigger
+  std::size_t stolen_voices() const noexcept {
+    return stolen_.load(std::memory_order_relaxed);
+  }
+  // triggers that never played because too many arrived between renders
+  std::size_t dropped_triggers() const noexcept {
+    return triggers_.dropped_count();
+  }
+};
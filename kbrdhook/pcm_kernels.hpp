@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#  define KBRDHOOK_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  endif
+#endif
+
+// the avx2 kernels are compiled for avx2 regardless of the target flags and
+// are only called after cpu detection says it is available
+#if defined(KBRDHOOK_X86) && (defined(__GNUC__) || defined(__clang__))
+#  define KBRDHOOK_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#  define KBRDHOOK_TARGET_AVX2
+#endif
+
+// inner loops for mixing PCM. the int16 gain is Q15, so 32767 is unity.
+struct pcm_kernels {
+  // dst += src * gain
+  void (*mix_f32)(float* dst, const float* src, float gain, std::size_t n);
+  // buf *= gain
+  void (*gain_f32)(float* buf, float gain, std::size_t n);
+  // buf = clamp(buf, -1, 1)
+  void (*clip_f32)(float* buf, std::size_t n);
+  // dst = saturate(dst + (src * gain >> 15))
+  void (*mix_i16)(
+      std::int16_t* dst, const std::int16_t* src, std::int16_t gain,
+      std::size_t n);
+  // buf = saturate(buf * gain >> 15)
+  void (*gain_i16)(std::int16_t* buf, std::int16_t gain, std::size_t n);
+  // out = saturate(in * 32767), truncating
+  void (*saturate_f32_to_i16)(
+      const float* in, std::int16_t* out, std::size_t n);
+};
+
+enum class simd_level { scalar, sse2, avx2 };
+
+inline const char* to_string(simd_level level) noexcept {
+  switch (level) {
+    case simd_level::sse2:
+      return "sse2";
+    case simd_level::avx2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+namespace detail {
+namespace scalar_pcm {
+inline std::int16_t saturate16(std::int32_t v) noexcept {
+  return static_cast<std::int16_t>(std::clamp<std::int32_t>(v, -32768, 32767));
+}
+inline void mix_f32(float* dst, const float* src, float gain, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] += src[i] * gain;
+  }
+}
+inline void gain_f32(float* buf, float gain, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    buf[i] *= gain;
+  }
+}
+inline void clip_f32(float* buf, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    buf[i] = std::clamp(buf[i], -1.0f, 1.0f);
+  }
+}
+inline void mix_i16(
+    std::int16_t* dst, const std::int16_t* src, std::int16_t gain,
+    std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = saturate16(dst[i] + ((std::int32_t(src[i]) * gain) >> 15));
+  }
+}
+inline void gain_i16(std::int16_t* buf, std::int16_t gain, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    buf[i] = saturate16((std::int32_t(buf[i]) * gain) >> 15);
+  }
+}
+inline void
+saturate_f32_to_i16(const float* in, std::int16_t* out, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    out[i] =
+        static_cast<std::int16_t>(std::clamp(in[i], -1.0f, 1.0f) * 32767.0f);
+  }
+}
+}  // namespace scalar_pcm
+
+#if defined(KBRDHOOK_X86)
+namespace sse2_pcm {
+// (a * b) >> 15 for 8 lanes, saturated back to 16 bits
+inline __m128i mul_q15(__m128i a, __m128i b) noexcept {
+  auto lo = _mm_mullo_epi16(a, b);
+  auto hi = _mm_mulhi_epi16(a, b);
+  auto p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 15);
+  auto p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 15);
+  return _mm_packs_epi32(p0, p1);
+}
+inline void mix_f32(float* dst, const float* src, float gain, std::size_t n) {
+  auto g = _mm_set1_ps(gain);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    auto d = _mm_loadu_ps(dst + i);
+    auto s = _mm_loadu_ps(src + i);
+    _mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(s, g)));
+  }
+  scalar_pcm::mix_f32(dst + i, src + i, gain, n - i);
+}
+inline void gain_f32(float* buf, float gain, std::size_t n) {
+  auto g = _mm_set1_ps(gain);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(buf + i, _mm_mul_ps(_mm_loadu_ps(buf + i), g));
+  }
+  scalar_pcm::gain_f32(buf + i, gain, n - i);
+}
+inline void clip_f32(float* buf, std::size_t n) {
+  auto lo = _mm_set1_ps(-1.0f);
+  auto hi = _mm_set1_ps(1.0f);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    auto v = _mm_loadu_ps(buf + i);
+    _mm_storeu_ps(buf + i, _mm_min_ps(_mm_max_ps(v, lo), hi));
+  }
+  scalar_pcm::clip_f32(buf + i, n - i);
+}
+inline void mix_i16(
+    std::int16_t* dst, const std::int16_t* src, std::int16_t gain,
+    std::size_t n) {
+  auto g = _mm_set1_epi16(gain);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(dst + i), _mm_adds_epi16(d, mul_q15(s, g)));
+  }
+  scalar_pcm::mix_i16(dst + i, src + i, gain, n - i);
+}
+inline void gain_i16(std::int16_t* buf, std::int16_t gain, std::size_t n) {
+  auto g = _mm_set1_epi16(gain);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(buf + i), mul_q15(v, g));
+  }
+  scalar_pcm::gain_i16(buf + i, gain, n - i);
+}
+inline void
+saturate_f32_to_i16(const float* in, std::int16_t* out, std::size_t n) {
+  auto lo = _mm_set1_ps(-1.0f);
+  auto hi = _mm_set1_ps(1.0f);
+  auto scale = _mm_set1_ps(32767.0f);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), lo), hi);
+    auto b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), lo), hi);
+    auto packed = _mm_packs_epi32(
+        _mm_cvttps_epi32(_mm_mul_ps(a, scale)),
+        _mm_cvttps_epi32(_mm_mul_ps(b, scale)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+  }
+  scalar_pcm::saturate_f32_to_i16(in + i, out + i, n - i);
+}
+}  // namespace sse2_pcm
+
+namespace avx2_pcm {
+KBRDHOOK_TARGET_AVX2 inline __m256i mul_q15(__m256i a, __m256i b) noexcept {
+  // unpack and pack both work within 128 bit lanes, so the order survives
+  auto lo = _mm256_mullo_epi16(a, b);
+  auto hi = _mm256_mulhi_epi16(a, b);
+  auto p0 = _mm256_srai_epi32(_mm256_unpacklo_epi16(lo, hi), 15);
+  auto p1 = _mm256_srai_epi32(_mm256_unpackhi_epi16(lo, hi), 15);
+  return _mm256_packs_epi32(p0, p1);
+}
+KBRDHOOK_TARGET_AVX2 inline void
+mix_f32(float* dst, const float* src, float gain, std::size_t n) {
+  auto g = _mm256_set1_ps(gain);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto d = _mm256_loadu_ps(dst + i);
+    auto s = _mm256_loadu_ps(src + i);
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(d, _mm256_mul_ps(s, g)));
+  }
+  scalar_pcm::mix_f32(dst + i, src + i, gain, n - i);
+}
+KBRDHOOK_TARGET_AVX2 inline void
+gain_f32(float* buf, float gain, std::size_t n) {
+  auto g = _mm256_set1_ps(gain);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(buf + i, _mm256_mul_ps(_mm256_loadu_ps(buf + i), g));
+  }
+  scalar_pcm::gain_f32(buf + i, gain, n - i);
+}
+KBRDHOOK_TARGET_AVX2 inline void clip_f32(float* buf, std::size_t n) {
+  auto lo = _mm256_set1_ps(-1.0f);
+  auto hi = _mm256_set1_ps(1.0f);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto v = _mm256_loadu_ps(buf + i);
+    _mm256_storeu_ps(buf + i, _mm256_min_ps(_mm256_max_ps(v, lo), hi));
+  }
+  scalar_pcm::clip_f32(buf + i, n - i);
+}
+KBRDHOOK_TARGET_AVX2 inline void mix_i16(
+    std::int16_t* dst, const std::int16_t* src, std::int16_t gain,
+    std::size_t n) {
+  auto g = _mm256_set1_epi16(gain);
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+    auto s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dst + i),
+        _mm256_adds_epi16(d, mul_q15(s, g)));
+  }
+  scalar_pcm::mix_i16(dst + i, src + i, gain, n - i);
+}
+KBRDHOOK_TARGET_AVX2 inline void
+gain_i16(std::int16_t* buf, std::int16_t gain, std::size_t n) {
+  auto g = _mm256_set1_epi16(gain);
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf + i), mul_q15(v, g));
+  }
+  scalar_pcm::gain_i16(buf + i, gain, n - i);
+}
+KBRDHOOK_TARGET_AVX2 inline void
+saturate_f32_to_i16(const float* in, std::int16_t* out, std::size_t n) {
+  auto lo = _mm256_set1_ps(-1.0f);
+  auto hi = _mm256_set1_ps(1.0f);
+  auto scale = _mm256_set1_ps(32767.0f);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i), lo), hi);
+    auto wide = _mm256_cvttps_epi32(_mm256_mul_ps(v, scale));
+    auto packed = _mm_packs_epi32(
+        _mm256_castsi256_si128(wide), _mm256_extracti128_si256(wide, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+  }
+  scalar_pcm::saturate_f32_to_i16(in + i, out + i, n - i);
+}
+}  // namespace avx2_pcm
+#endif
+}  // namespace detail
+
+// the widest instruction set that both the cpu and the os support
+inline simd_level detect_simd_level() noexcept {
+#if defined(KBRDHOOK_X86)
+#  if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  const int maxLeaf = info[0];
+  __cpuid(info, 1);
+  const bool sse2 = (info[3] & (1 << 26)) != 0;
+  // avx state must be saved by the os
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  bool avx2 = false;
+  if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1 << 5)) != 0;
+  }
+  return avx2 ? simd_level::avx2
+      : sse2  ? simd_level::sse2
+              : simd_level::scalar;
+#  else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return simd_level::avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return simd_level::sse2;
+  }
+#  endif
+#endif
+  return simd_level::scalar;
+}
+
+// the kernels for one instruction set. levels above what this build
+// supports fall back to scalar.
+inline const pcm_kernels& get_pcm_kernels(simd_level level) noexcept {
+  namespace d = detail;
+  static constexpr pcm_kernels scalar{
+      &d::scalar_pcm::mix_f32,
+      &d::scalar_pcm::gain_f32,
+      &d::scalar_pcm::clip_f32,
+      &d::scalar_pcm::mix_i16,
+      &d::scalar_pcm::gain_i16,
+      &d::scalar_pcm::saturate_f32_to_i16};
+#if defined(KBRDHOOK_X86)
+  static constexpr pcm_kernels sse2{
+      &d::sse2_pcm::mix_f32,
+      &d::sse2_pcm::gain_f32,
+      &d::sse2_pcm::clip_f32,
+      &d::sse2_pcm::mix_i16,
+      &d::sse2_pcm::gain_i16,
+      &d::sse2_pcm::saturate_f32_to_i16};
+  static constexpr pcm_kernels avx2{
+      &d::avx2_pcm::mix_f32,
+      &d::avx2_pcm::gain_f32,
+      &d::avx2_pcm::clip_f32,
+      &d::avx2_pcm::mix_i16,
+      &d::avx2_pcm::gain_i16,
+      &d::avx2_pcm::saturate_f32_to_i16};
+  switch (level) {
+    case simd_level::avx2:
+      return avx2;
+    case simd_level::sse2:
+      return sse2;
+    default:
+      break;
+  }
+#endif
+  (void)level;
+  return scalar;
+}
+
+// the fastest kernels for this machine, detected once
+inline const pcm_kernels& active_pcm_kernels() noexcept {
+  static const pcm_kernels& kernels = get_pcm_kernels(detect_simd_level());
+  return kernels;
+}
@@ -16,210 +16,136 @@
 
 #pragma once
 
-#include <unifex/async_manual_reset_event.hpp>
-#include <unifex/async_scope.hpp>
 #include <unifex/just_from.hpp>
-#include <unifex/manual_event_loop.hpp>
 #include <unifex/scheduler_concepts.hpp>
-#include <unifex/scope_guard.hpp>
 #include <unifex/sender_concepts.hpp>
 #include <unifex/sequence.hpp>
 
+#include "audio_output.hpp"
+#include "audio_sink.hpp"
 #include "com_thread.hpp"
-
-#include <mfplay.h>
-#include <windows.h>
-#include <windowsx.h>
-#include <winuser.h>
-#pragma comment(lib, "mfplay.lib")
-#include <Shlwapi.h>
-#include <mferror.h>
-#include <shobjidl.h>  // defines IFileOpenDialog
-#pragma comment(lib, "shlwapi.lib")
-#include <strsafe.h>
+#include "mixer.hpp"
+#include "key_event.hpp"
+#include "sample_cache.hpp"
+#include "sample_source.hpp"
+#include "sound_bank.hpp"
+#include "spawn_pool.hpp"
+#include "trace.hpp"
+
+#if defined(_WIN32)
+#  include <windows.h>
+#  include <strsafe.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
 
 struct Player {
-  class MediaPlayerCallback : public IMFPMediaPlayerCallback {
-    size_t id_;
-    Player* player_;
-    long m_cRef;  // Reference count
-
-  public:
-    explicit MediaPlayerCallback(Player* player, size_t id)
-      : id_(id)
-      , player_(player)
-      , m_cRef(1) {}
-
-    STDMETHODIMP QueryInterface(REFIID riid, void** ppv) {
-      static const QITAB qit[] = {
-          QITABENT(MediaPlayerCallback, IMFPMediaPlayerCallback),
-          {0},
-      };
-      return QISearch(this, qit, riid, ppv);
-    }
-    STDMETHODIMP_(ULONG) AddRef() { return InterlockedIncrement(&m_cRef); }
-    STDMETHODIMP_(ULONG) Release() {
-      ULONG count = InterlockedDecrement(&m_cRef);
-      if (count == 0) {
-        delete this;
-        return 0;
-      }
-      return count;
-    }
-
-    // IMFPMediaPlayerCallback methods
-    void STDMETHODCALLTYPE OnMediaPlayerEvent(MFP_EVENT_HEADER* pEventHeader) {
-      if (FAILED(pEventHeader->hrEvent)) {
-        player_->ShowErrorMessage(L"Playback error", pEventHeader->hrEvent);
-        return;
-      }
-
-      switch (pEventHeader->eEventType) {
-        case MFP_EVENT_TYPE_MEDIAITEM_CREATED: {
-          auto* pEvent = MFP_GET_MEDIAITEM_CREATED_EVENT(pEventHeader);
-          auto pMediaItem = pEvent->pMediaItem;
-          // The media item was created successfully.
-          player_->players_[id_].ItemCreated(player_, pMediaItem);
-        } break;
-
-        case MFP_EVENT_TYPE_MEDIAITEM_SET:
-          // set completed
-          player_->players_[id_].ItemSet(player_);
-          break;
-      }
-    }
-  };
-
-  struct player {
-    ~player() { destroy(); }
-    player() : id_(-1), pCallback_(nullptr), pPlayer_(nullptr) {}
-    void start(Player* player, size_t id) {
-      HRESULT hr = S_OK;
-
-      id_ = id;
-      pCallback_ = new (std::nothrow) MediaPlayerCallback{player, id_};
-
-      hr = MFPCreateMediaPlayer(
-          NULL,
-          FALSE,       // Start playback automatically?
-          0,           // Flags
-          pCallback_,  // Callback pointer
-          NULL,        // Video window
-          &pPlayer_);
-      if (FAILED(hr)) {
-        std::terminate();
-      }
-
-      // Create a new media item for this URL.
-      hr = pPlayer_->CreateMediaItemFromURL(
-          L"https://webwit.nl/input/kbsim/mp3/1_.mp3", FALSE, 0, NULL);
-      if (FAILED(hr)) {
-        std::terminate();
-      }
-      printf("player started\n");
-      fflush(stdout);
-    }
-
-    void destroy() {
-      if (!!pPlayer_) {
-        std::exchange(pPlayer_, nullptr)->Release();
-      }
-      if (!!pCallback_) {
-        std::exchange(pCallback_, nullptr)->Release();
-        printf("player exit\n");
-        fflush(stdout);
-      }
-    }
-
-    void Click() {
-      HRESULT hr = pPlayer_->Stop();
-      if (FAILED(hr)) {
-        std::terminate();
-      }
-      hr = pPlayer_->Play();
-      if (FAILED(hr)) {
-        std::terminate();
-      }
-    }
-
-    void ItemCreated(Player* player, IMFPMediaItem* pMediaItem) {
-      HRESULT hr = S_OK;
-
-      // The media item was created successfully.
-
-      if (pPlayer_) {
-        // Set the media item on the player. This method completes
-        // asynchronously.
-        hr = pPlayer_->SetMediaItem(pMediaItem);
-      }
-
-      if (FAILED(hr)) {
-        player->ShowErrorMessage(L"Error playing this file.", hr);
-      }
-    }
-
-    void ItemSet(Player* player) {
-      if (++player->ready_ == player->players_.size()) {
-        player->playersReady_.set();
-      }
-    }
-
-    size_t id_;
-    IMFPMediaPlayerCallback* pCallback_;  // Application callback object.
-    IMFPMediaPlayer* pPlayer_;            // The MFPlay player object.
-  };
   using scheduler_t = decltype(std::declval<com_thread>().get_scheduler());
 
-  scheduler_t uiLoop_;
-  std::array<player, 1> players_;
-  size_t current_;
-  unifex::async_scope scope_;
-  size_t ready_;
-  unifex::async_manual_reset_event playersReady_;
+  static inline constexpr std::uint32_t sampleRate = 48000;
+  static inline constexpr std::size_t voiceCount = 32;
+  // how far the mixer renders ahead of the device, about 10ms
+  static inline constexpr std::size_t aheadFrames = 512;
+  // clicks and error messages in flight at once. more than this are
+  // dropped.
+  static inline constexpr std::size_t spawnCapacity = 64;
+  using mixer_t = mixer<voiceCount>;
+#if defined(_WIN32)
+  using sink_t = waveout_sink;
+#else
+  using sink_t = null_sink;
+#endif
 
-  explicit Player(scheduler_t uiLoop)
+  scheduler_t uiLoop_;
+  // clicks are latency critical and must not wait behind other work
+  scheduler_t clickLoop_;
+  // local sound files, decoded on the first run and mapped after that
+  std::filesystem::path soundDirectory_;
+  sample_cache samples_;
+  // used when there is no click.wav
+  std::vector<float> synthesized_;
+  // read by the audio thread
+  sound_bank bank_;
+  mixer_t mixer_;
+  std::optional<audio_output<mixer_t, sink_t>> output_;
+  // spawns without allocating
+  spawn_pool<spawnCapacity> spawns_;
+
+  explicit Player(
+      scheduler_t uiLoop,
+      scheduler_t clickLoop,
+      std::filesystem::path soundDirectory = ".")
     : uiLoop_(uiLoop)
-    , current_(0)
-    , ready_(0) {}
+    , clickLoop_(clickLoop)
+    , soundDirectory_(std::move(soundDirectory))
+    , samples_(sample_cache::default_directory(), sampleRate) {}
 
   auto start() {
     return unifex::sequence(
-        unifex::schedule(uiLoop_),
+        unifex::schedule(uiLoop_.with_label("Player::start")),
         unifex::just_from([this]() {
-          for (auto& p : players_) {
-            p.start(this, current_++ % players_.size());
-          }
-        }),
-        playersReady_.async_wait());
+          synthesized_ = synthesize_click(sampleRate);
+          bank_.load(samples_, soundDirectory_, synthesized_);
+          // a machine without an audio device plays silence
+          output_.emplace(mixer_, aheadFrames, sampleRate);
+          printf("player started\n");
+          fflush(stdout);
+        }));
   }
 
   [[nodiscard]] auto destroy() {
     return unifex::sequence(
         unifex::schedule(uiLoop_),
         unifex::just_from([this]() {
-          for (auto& p : players_) {
-            p.destroy();
+          if (!!output_) {
+            auto underruns = output_->underruns();
+            output_.reset();
+            printf("player exit, %zu audio underruns\n", underruns);
+            fflush(stdout);
           }
         }),
-        scope_.complete());
+        spawns_.complete());
   }
 
-  void Click() {
-    scope_.spawn_call_on(uiLoop_, [this]() noexcept {
-      players_[++current_ % players_.size()].Click();
-    });
+  // overlapping clicks play on separate voices
+  void Click(key_event event) {
+    KBRDHOOK_TRACE(trace_stage::spawn, event);
+    (void)spawns_.spawn_call_on(
+        clickLoop_.with_label("Player::Click"),
+        [this, event]() mutable noexcept {
+          KBRDHOOK_TRACE_END(trace_stage::click, event);
+          mixer_.trigger(bank_.sample_for(event));
+        });
   }
 
-  void ShowErrorMessage(PCWSTR format, HRESULT hrErr) {
-    scope_.spawn_call_on(uiLoop_, [this, format, hrErr]() noexcept {
-      HRESULT hr = S_OK;
-      WCHAR str[MAX_PATH];
-
-      hr = StringCbPrintfW(str, sizeof(str), L"%s (hr=0x%X)", format, hrErr);
+  void ShowErrorMessage(const char* message, long errorCode) {
+    auto show = [message, errorCode]() noexcept {
+#if defined(_WIN32)
+      char str[MAX_PATH];
+      HRESULT hr = StringCbPrintfA(
+          str, sizeof(str), "%s (hr=0x%lX)", message, errorCode);
 
       if (SUCCEEDED(hr)) {
-        MessageBoxW(NULL, str, L"Error", MB_ICONERROR);
+        MessageBoxA(NULL, str, "Error", MB_ICONERROR);
       }
-    });
+#else
+      fprintf(stderr, "%s (error=0x%lX)\n", message, errorCode);
+#endif
+    };
+    if (!spawns_.spawn_call_on(
+            uiLoop_.with_label("Player::ShowErrorMessage"), show)) {
+      fprintf(stderr, "%s (error=0x%lX)\n", message, errorCode);
+    }
   }
-};
\ No newline at end of file
+
+  // clicks and messages spawned and not yet run
+  std::size_t spawns_in_flight() const noexcept { return spawns_.in_use(); }
+  // clicks dropped because every spawn slot was busy
+  std::size_t dropped_clicks() const noexcept { return spawns_.dropped(); }
+};
@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <unifex/receiver_concepts.hpp>
+#include <unifex/scheduler_concepts.hpp>
+#include <unifex/sender_concepts.hpp>
+#include <unifex/stop_token_concepts.hpp>
+#include <unifex/stop_when.hpp>
+#include <unifex/unstoppable_token.hpp>
+
+#include "sender_range.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+// adaptors over a range of senders (sender_range::view(), or the view() of
+// another adaptor) that drop or merge events before the consumer sees them:
+//
+//   distinct_until_changed(view)       events that differ from the last one
+//   throttle(view, scheduler, period)  at most one event per period
+//   debounce(view, scheduler, quiet)   the last event once the source has
+//                                      been quiet for a while
+//   coalesce(view, scheduler, window)  the events in a window, merged
+//
+// the scheduler is a unifex time scheduler (now() and schedule_at()). like
+// sender_range, only one sender from an adapted range may be started at a
+// time. events that arrive while no sender is started stay in the
+// upstream range's buffer.
+
+namespace detail {
+template <typename... Values>
+struct _single_value;
+template <typename Value>
+struct _single_value<Value> {
+  using type = std::decay_t<Value>;
+};
+template <typename... Overloads>
+struct _single_overload;
+template <typename Overload>
+struct _single_overload<Overload> {
+  using type = typename Overload::type;
+};
+
+// the event type of a range of senders that each complete with one event
+template <typename Range>
+using range_event_t = typename unifex::sender_traits<
+    std::decay_t<decltype(*std::declval<Range&>().begin())>>::
+    template value_types<_single_overload, _single_value>::type;
+
+template <typename Receiver>
+auto _stop_token_of(Receiver& rec) noexcept {
+  if constexpr (unifex::is_callable_v<
+                    unifex::tag_t<unifex::get_stop_token>,
+                    Receiver&>) {
+    return unifex::get_stop_token(rec);
+  } else {
+    return unifex::unstoppable_token{};
+  }
+}
+}  // namespace detail
+
+// what an adaptor policy does with an event
+enum class adaptor_step {
+  // complete the sender with the held event
+  emit,
+  // wait for the next event
+  pull,
+  // wait for the next event until the deadline, then emit the held event
+  pull_until
+};
+
+// an adapted range of senders. each sender pulls events from Upstream and
+// hands them to Policy until the policy emits one.
+template <typename Upstream, typename Policy>
+class adapted_range {
+public:
+  using event_t = detail::range_event_t<Upstream>;
+
+private:
+  using upstream_iterator_t = decltype(std::declval<Upstream&>().begin());
+  using upstream_sender_t =
+      std::decay_t<decltype(*std::declval<upstream_iterator_t&>())>;
+  using time_point_t = typename Policy::time_point_t;
+
+  Upstream upstream_;
+  upstream_iterator_t next_;
+  Policy policy_;
+  // the upstream range completed with done
+  bool ended_{false};
+  // the event the policy will emit and when. this outlives the sender that
+  // pulled the event, so a held event survives a cancelled sender and is
+  // emitted by the next one.
+  std::optional<event_t> held_;
+  time_point_t deadline_{};
+  adaptor_step step_{adaptor_step::pull};
+
+  upstream_sender_t next_sender() {
+    auto sender = *next_;
+    ++next_;
+    return sender;
+  }
+
+  struct make_sender {
+    template <
+        template <typename...>
+        class Variant,
+        template <typename...>
+        class Tuple>
+    using value_types = Variant<Tuple<event_t>>;
+
+    template <template <typename...> class Variant>
+    using error_types = Variant<std::exception_ptr>;
+
+    static inline constexpr bool sends_done = true;
+
+    template <typename Receiver>
+    struct state {
+      using stop_token_t =
+          decltype(detail::_stop_token_of(std::declval<Receiver&>()));
+
+      // receives the result of one upstream sender
+      struct child_receiver {
+        state* state_;
+
+        template <typename... Values>
+        void set_value(Values&&... values) noexcept {
+          state_->on_event(event_t{(Values &&) values...});
+        }
+        void set_done() noexcept { state_->on_done(); }
+        template <typename Error>
+        void set_error(Error&& error) noexcept {
+          if constexpr (std::is_same_v<
+                            std::decay_t<Error>,
+                            std::exception_ptr>) {
+            state_->on_error((Error &&) error);
+          } else {
+            state_->on_error(std::make_exception_ptr((Error &&) error));
+          }
+        }
+
+        // cancelling the adapted sender cancels the upstream sender
+        friend stop_token_t tag_invoke(
+            unifex::tag_t<unifex::get_stop_token>,
+            const child_receiver& r) noexcept {
+          return r.state_->stopToken_;
+        }
+      };
+
+      using plain_op_t =
+          unifex::connect_result_t<upstream_sender_t, child_receiver>;
+      using timed_op_t = typename Policy::template timed_op_t<
+          upstream_sender_t,
+          child_receiver>;
+      using optional_timed_op_t = std::conditional_t<
+          Policy::uses_deadline,
+          std::optional<timed_op_t>,
+          std::monostate>;
+
+      adapted_range* range_;
+      Receiver& rec_;
+      stop_token_t stopToken_;
+      bool done_{false};
+      std::exception_ptr error_;
+      // at most one of these is running
+      std::optional<plain_op_t> plain_;
+      optional_timed_op_t timed_;
+      // counts advance() calls. a child that completes while start() is
+      // still on the stack leaves the next step to the loop in advance()
+      // instead of recursing.
+      std::atomic<int> advancing_{0};
+
+      state(adapted_range* range, Receiver& rec)
+        : range_(range)
+        , rec_(rec)
+        , stopToken_(detail::_stop_token_of(rec)) {
+        done_ = range_->ended_;
+        advance();
+      }
+      state(state&&) = delete;
+
+      void on_event(event_t&& event) noexcept {
+        range_->step_ = range_->policy_.on_event(
+            std::move(event), range_->held_, range_->deadline_);
+        advance();
+      }
+
+      void on_done() noexcept {
+        if (stopToken_.stop_requested()) {
+          // the held event stays in the range for the next sender
+          done_ = true;
+        } else if (
+            range_->step_ == adaptor_step::pull_until &&
+            range_->policy_.now() >= range_->deadline_) {
+          // the deadline passed
+          range_->step_ = adaptor_step::emit;
+        } else {
+          // the upstream range has ended. the held event is still emitted.
+          range_->ended_ = true;
+          if (!!range_->held_) {
+            range_->step_ = adaptor_step::emit;
+          } else {
+            done_ = true;
+          }
+        }
+        advance();
+      }
+
+      void on_error(std::exception_ptr error) noexcept {
+        error_ = std::move(error);
+        advance();
+      }
+
+      void start_child() noexcept {
+        // the last child has completed, and is only ever destroyed after
+        // it called its receiver
+        plain_.reset();
+        if constexpr (Policy::uses_deadline) {
+          timed_.reset();
+          if (range_->step_ == adaptor_step::pull_until) {
+            timed_.emplace(detail::_conv{[this]() {
+              return unifex::connect(
+                  range_->policy_.until(
+                      range_->next_sender(), range_->deadline_),
+                  child_receiver{this});
+            }});
+            unifex::start(*timed_);
+            return;
+          }
+        }
+        plain_.emplace(detail::_conv{[this]() {
+          return unifex::connect(range_->next_sender(), child_receiver{this});
+        }});
+        unifex::start(*plain_);
+      }
+
+      void advance() noexcept {
+        if (advancing_.fetch_add(1, std::memory_order_acq_rel) != 0) {
+          return;
+        }
+        for (;;) {
+          // completing the receiver may destroy this state, so it is the
+          // last thing done
+          if (!!error_) {
+            unifex::set_error(std::move(rec_), std::move(error_));
+            return;
+          }
+          if (range_->step_ == adaptor_step::emit) {
+            auto event = std::move(*range_->held_);
+            range_->held_.reset();
+            range_->step_ = adaptor_step::pull;
+            unifex::set_value(std::move(rec_), std::move(event));
+            return;
+          }
+          if (done_) {
+            unifex::set_done(std::move(rec_));
+            return;
+          }
+          start_child();
+          if (advancing_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            // the child completes later and calls advance() again
+            return;
+          }
+        }
+      }
+    };
+
+    template <typename Receiver>
+    state<Receiver> operator()(Receiver& rec, adapted_range* range) noexcept {
+      return {range, rec};
+    }
+  };
+
+  static auto make_range(adapted_range* self) {
+    return std::views::iota(0) | std::views::transform([self](int) {
+             return unifex::create(make_sender{}, self);
+           });
+  }
+  using RangeType = decltype(make_range(nullptr));
+  RangeType range_;
+
+  struct sender_view {
+    RangeType* range_;
+
+    auto begin() { return range_->begin(); }
+    auto end() { return range_->end(); }
+  };
+
+public:
+  adapted_range(Upstream upstream, Policy policy)
+    : upstream_(std::move(upstream))
+    , next_(upstream_.begin())
+    , policy_(std::move(policy))
+    , range_(make_range(this)) {}
+  // range_ points back at this. chain adaptors through view().
+  adapted_range(adapted_range&&) = delete;
+
+  auto view() { return sender_view{&range_}; }
+
+  auto begin() noexcept { return range_.begin(); }
+  auto end() noexcept { return range_.end(); }
+};
+
+// policies without a timer
+struct _untimed_policy {
+  static inline constexpr bool uses_deadline = false;
+  using time_point_t = std::chrono::steady_clock::time_point;
+  template <typename Sender, typename Receiver>
+  using timed_op_t = std::monostate;
+  time_point_t now() const noexcept { return {}; }
+};
+
+// policies that race the next event against a deadline
+template <typename Scheduler>
+struct _timed_policy {
+  static inline constexpr bool uses_deadline = true;
+  using time_point_t = decltype(unifex::now(std::declval<Scheduler&>()));
+  template <typename Sender>
+  using until_t = decltype(unifex::stop_when(
+      std::declval<Sender>(),
+      unifex::schedule_at(
+          std::declval<Scheduler&>(), std::declval<time_point_t>())));
+  template <typename Sender, typename Receiver>
+  using timed_op_t = unifex::connect_result_t<until_t<Sender>, Receiver>;
+
+  Scheduler scheduler_;
+
+  time_point_t now() { return unifex::now(scheduler_); }
+  // sender completes with done at the deadline
+  template <typename Sender>
+  until_t<Sender> until(Sender&& sender, time_point_t deadline) {
+    return unifex::stop_when(
+        (Sender &&) sender, unifex::schedule_at(scheduler_, deadline));
+  }
+};
+
+template <typename EventType, typename Equal>
+struct _distinct_policy : _untimed_policy {
+  Equal equal_;
+  std::optional<EventType> last_;
+
+  template <typename TimePoint>
+  adaptor_step on_event(
+      EventType&& event, std::optional<EventType>& held, TimePoint&) {
+    if (!!last_ && equal_(*last_, event)) {
+      return adaptor_step::pull;
+    }
+    last_ = event;
+    held = std::move(event);
+    return adaptor_step::emit;
+  }
+};
+
+template <typename EventType, typename Scheduler>
+struct _throttle_policy : _timed_policy<Scheduler> {
+  using time_point_t = typename _timed_policy<Scheduler>::time_point_t;
+  static inline constexpr bool uses_deadline = false;
+
+  typename time_point_t::duration period_;
+  std::optional<time_point_t> next_;
+
+  adaptor_step on_event(
+      EventType&& event, std::optional<EventType>& held, time_point_t&) {
+    auto now = this->now();
+    if (!!next_ && now < *next_) {
+      return adaptor_step::pull;
+    }
+    next_ = now + period_;
+    held = std::move(event);
+    return adaptor_step::emit;
+  }
+};
+
+template <typename EventType, typename Scheduler>
+struct _debounce_policy : _timed_policy<Scheduler> {
+  using time_point_t = typename _timed_policy<Scheduler>::time_point_t;
+
+  typename time_point_t::duration quiet_;
+
+  adaptor_step on_event(
+      EventType&& event,
+      std::optional<EventType>& held,
+      time_point_t& deadline) {
+    held = std::move(event);
+    deadline = this->now() + quiet_;
+    return adaptor_step::pull_until;
+  }
+};
+
+// the default merge for coalesce() keeps the newest event
+struct keep_latest {
+  template <typename EventType>
+  void operator()(EventType& held, EventType&& next) const {
+    held = std::move(next);
+  }
+};
+
+template <typename EventType, typename Scheduler, typename Merge>
+struct _coalesce_policy : _timed_policy<Scheduler> {
+  using time_point_t = typename _timed_policy<Scheduler>::time_point_t;
+
+  typename time_point_t::duration window_;
+  Merge merge_;
+
+  adaptor_step on_event(
+      EventType&& event,
+      std::optional<EventType>& held,
+      time_point_t& deadline) {
+    if (!held) {
+      // the first event opens the window
+      held = std::move(event);
+      deadline = this->now() + window_;
+    } else {
+      merge_(*held, std::move(event));
+    }
+    return adaptor_step::pull_until;
+  }
+};
+
+// drop events equal to the last event emitted. (key auto-repeat sends the
+// same WM_KEYDOWN again, but so does pressing the same key twice, since
+// the hook does not pass key ups on.)
+template <typename Upstream, typename Equal = std::equal_to<>>
+auto distinct_until_changed(Upstream upstream, Equal equal = {}) {
+  using event_t = detail::range_event_t<Upstream>;
+  using policy_t = _distinct_policy<event_t, Equal>;
+  return adapted_range<Upstream, policy_t>{
+      std::move(upstream), policy_t{{}, std::move(equal), std::nullopt}};
+}
+
+// emit an event, then drop events until period has passed
+template <typename Upstream, typename Scheduler, typename Duration>
+auto throttle(Upstream upstream, Scheduler scheduler, Duration period) {
+  using event_t = detail::range_event_t<Upstream>;
+  using policy_t = _throttle_policy<event_t, Scheduler>;
+  using duration_t = typename policy_t::time_point_t::duration;
+  return adapted_range<Upstream, policy_t>{
+      std::move(upstream),
+      policy_t{
+          {std::move(scheduler)},
+          std::chrono::duration_cast<duration_t>(period),
+          std::nullopt}};
+}
+
+// emit the last of a run of events once no event has arrived for quiet
+template <typename Upstream, typename Scheduler, typename Duration>
+auto debounce(Upstream upstream, Scheduler scheduler, Duration quiet) {
+  using event_t = detail::range_event_t<Upstream>;
+  using policy_t = _debounce_policy<event_t, Scheduler>;
+  using duration_t = typename policy_t::time_point_t::duration;
+  return adapted_range<Upstream, policy_t>{
+      std::move(upstream),
+      policy_t{
+          {std::move(scheduler)},
+          std::chrono::duration_cast<duration_t>(quiet)}};
+}
+
+// merge the events that arrive within window of the first one into one
+// event, emitted when the window closes
+template <
+    typename Upstream,
+    typename Scheduler,
+    typename Duration,
+    typename Merge = keep_latest>
+auto coalesce(
+    Upstream upstream, Scheduler scheduler, Duration window, Merge merge = {}) {
+  using event_t = detail::range_event_t<Upstream>;
+  using policy_t = _coalesce_policy<event_t, Scheduler, Merge>;
+  using duration_t = typename policy_t::time_point_t::duration;
+  return adapted_range<Upstream, policy_t>{
+      std::move(upstream),
+      policy_t{
+          {std::move(scheduler)},
+          std::chrono::duration_cast<duration_t>(window),
+          std::move(merge)}};
+}
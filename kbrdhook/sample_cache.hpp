@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "mapped_file.hpp"
+#include "sample_source.hpp"
+
+#if defined(_WIN32)
+#  include <windows.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+// decode a PCM or IEEE float wav file to mono float at sampleRate. returns
+// nothing when the file is not a wav file this can read.
+inline std::optional<std::vector<float>>
+decode_wav(std::span<const std::uint8_t> file, std::uint32_t sampleRate) {
+  auto u16 = [&](std::size_t at) {
+    return std::uint32_t(file[at]) | std::uint32_t(file[at + 1]) << 8;
+  };
+  auto u32 = [&](std::size_t at) { return u16(at) | u16(at + 2) << 16; };
+
+  if (file.size() < 12 || std::memcmp(file.data(), "RIFF", 4) != 0 ||
+      std::memcmp(file.data() + 8, "WAVE", 4) != 0) {
+    return std::nullopt;
+  }
+  std::uint32_t format = 0, channels = 0, rate = 0, bits = 0;
+  std::span<const std::uint8_t> data;
+  for (std::size_t at = 12; at + 8 <= file.size();) {
+    auto size = std::min<std::size_t>(u32(at + 4), file.size() - at - 8);
+    auto body = at + 8;
+    if (std::memcmp(file.data() + at, "fmt ", 4) == 0 && size >= 16) {
+      format = u16(body);
+      channels = u16(body + 2);
+      rate = u32(body + 4);
+      bits = u16(body + 14);
+      // WAVE_FORMAT_EXTENSIBLE keeps the real format in the sub format guid
+      if (format == 0xFFFE && size >= 26) {
+        format = u16(body + 24);
+      }
+    } else if (std::memcmp(file.data() + at, "data", 4) == 0) {
+      data = file.subspan(body, size);
+    }
+    at = body + size + (size & 1);
+  }
+  const bool pcm = format == 1 && (bits == 8 || bits == 16 || bits == 24 ||
+                                   bits == 32);
+  const bool ieee = format == 3 && bits == 32;
+  if ((!pcm && !ieee) || channels == 0 || rate == 0 || data.empty()) {
+    return std::nullopt;
+  }
+
+  const std::size_t bytesPerSample = bits / 8;
+  const std::size_t frames = data.size() / (bytesPerSample * channels);
+  auto sample = [&](std::size_t at) -> float {
+    const auto* p = data.data() + at;
+    switch (bits) {
+      case 8:
+        return (float(p[0]) - 128.0f) / 128.0f;
+      case 16:
+        return float(std::int16_t(p[0] | p[1] << 8)) / 32768.0f;
+      case 24:
+        return float(std::int32_t(
+                   std::uint32_t(p[0]) << 8 | std::uint32_t(p[1]) << 16 |
+                   std::uint32_t(p[2]) << 24)) /
+            2147483648.0f;
+      default: {
+        std::uint32_t raw = std::uint32_t(p[0]) | std::uint32_t(p[1]) << 8 |
+            std::uint32_t(p[2]) << 16 | std::uint32_t(p[3]) << 24;
+        if (ieee) {
+          float f;
+          std::memcpy(&f, &raw, sizeof(f));
+          return f;
+        }
+        return float(std::int32_t(raw)) / 2147483648.0f;
+      }
+    }
+  };
+
+  // mix down to mono
+  std::vector<float> mono(frames);
+  for (std::size_t f = 0; f < frames; ++f) {
+    float sum = 0.0f;
+    for (std::size_t c = 0; c < channels; ++c) {
+      sum += sample((f * channels + c) * bytesPerSample);
+    }
+    mono[f] = sum / float(channels);
+  }
+  if (rate == sampleRate || frames < 2) {
+    return mono;
+  }
+
+  // linear resampling is plenty for a click
+  const auto outFrames =
+      std::size_t(double(frames) * sampleRate / rate);
+  std::vector<float> resampled(outFrames);
+  const double step = double(rate) / sampleRate;
+  for (std::size_t i = 0; i < outFrames; ++i) {
+    auto position = i * step;
+    auto index = std::min(std::size_t(position), frames - 2);
+    auto fraction = float(position - double(index));
+    resampled[i] = mono[index] + (mono[index + 1] - mono[index]) * fraction;
+  }
+  return resampled;
+}
+
+// decodes each local sound file once into mono float PCM at the mixer
+// sample rate, and keeps the result in a cache file next to the other
+// cached samples. later runs map the cache file instead of decoding.
+//
+// the cache file is named after the source file and a hash of its full
+// path, so sources with the same name in different directories do not
+// share a cache file. a cache file is reused while the path, the size and
+// write time of the source file and the sample rate match its header.
+class sample_cache {
+  struct header {
+    char magic_[4];
+    std::uint32_t version_;
+    std::uint32_t sampleRate_;
+    std::uint32_t reserved_;
+    std::uint64_t frames_;
+    std::uint64_t sourceSize_;
+    std::int64_t sourceTime_;
+    std::uint64_t sourcePath_;
+  };
+  static inline constexpr std::uint32_t version = 2;
+
+  std::filesystem::path directory_;
+  std::uint32_t sampleRate_;
+  std::size_t hits_{0};
+  std::size_t misses_{0};
+  // mapped_file is not movable and the spans handed out point into it
+  std::list<mapped_file> mapped_;
+  // samples that could not be written to the cache
+  std::list<std::vector<float>> unmapped_;
+
+  // fnv-1a of the absolute path. stable from run to run, unlike std::hash.
+  static std::uint64_t path_hash(const std::filesystem::path& source) {
+    std::error_code ec;
+    auto full = std::filesystem::weakly_canonical(source, ec);
+    if (ec) {
+      full = std::filesystem::absolute(source, ec);
+    }
+    const auto& name = full.native();
+    const auto* bytes = reinterpret_cast<const std::uint8_t*>(name.data());
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    for (std::size_t i = 0; i < name.size() * sizeof(name[0]); ++i) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+  }
+
+  header expected_header(const std::filesystem::path& source) const {
+    std::error_code ec;
+    header h{{'K', 'B', 'P', 'C'}, version, sampleRate_, 0, 0, 0, 0, 0};
+    h.sourcePath_ = path_hash(source);
+    h.sourceSize_ = std::filesystem::file_size(source, ec);
+    h.sourceTime_ = std::int64_t(
+        std::filesystem::last_write_time(source, ec)
+            .time_since_epoch()
+            .count());
+    return h;
+  }
+
+  static std::optional<std::vector<float>>
+  decode(const std::filesystem::path& source, std::uint32_t sampleRate) {
+    {
+      mapped_file file{source};
+      if (auto samples = decode_wav(file.bytes(), sampleRate)) {
+        return samples;
+      }
+    }
+#if defined(_WIN32)
+    // compressed formats go through media foundation, which takes a path
+    // where it takes a url
+    std::vector<float> samples;
+    HRESULT hr = MFStartup(MF_VERSION);
+    if (SUCCEEDED(hr)) {
+      hr = decode_with_media_foundation(source.c_str(), sampleRate, samples);
+      MFShutdown();
+    }
+    if (SUCCEEDED(hr) && !samples.empty()) {
+      return samples;
+    }
+#endif
+    return std::nullopt;
+  }
+
+  // write to a temporary file and rename it so that a crash never leaves a
+  // partial cache file behind
+  static bool write_cache(
+      const std::filesystem::path& path, const header& h,
+      std::span<const float> samples) {
+    auto temporary = path;
+    temporary += ".tmp";
+#if defined(_WIN32)
+    FILE* file = _wfopen(temporary.c_str(), L"wb");
+#else
+    FILE* file = fopen(temporary.c_str(), "wb");
+#endif
+    if (!file) {
+      return false;
+    }
+    bool written = fwrite(&h, sizeof(h), 1, file) == 1 &&
+        fwrite(samples.data(), sizeof(float), samples.size(), file) ==
+            samples.size();
+    written = fclose(file) == 0 && written;
+    std::error_code ec;
+    if (written) {
+      std::filesystem::rename(temporary, path, ec);
+    }
+    if (!written || ec) {
+      std::filesystem::remove(temporary, ec);
+      return false;
+    }
+    return true;
+  }
+
+  // map a cache file written for the same source and sample rate
+  std::span<const float>
+  map(const std::filesystem::path& path, header expected) {
+    auto& file = mapped_.emplace_back(path);
+    auto bytes = file.bytes();
+    header found{};
+    if (bytes.size() >= sizeof(header)) {
+      std::memcpy(&found, bytes.data(), sizeof(header));
+    }
+    // only the cache file knows how many frames it holds
+    expected.frames_ = found.frames_;
+    if (std::memcmp(&found, &expected, sizeof(header)) != 0 ||
+        bytes.size() != sizeof(header) + found.frames_ * sizeof(float)) {
+      mapped_.pop_back();
+      return {};
+    }
+    return {
+        reinterpret_cast<const float*>(bytes.data() + sizeof(header)),
+        std::size_t(found.frames_)};
+  }
+
+public:
+  sample_cache(std::filesystem::path directory, std::uint32_t sampleRate)
+    : directory_(std::move(directory))
+    , sampleRate_(sampleRate) {}
+  sample_cache(const sample_cache&) = delete;
+
+  // the default location, in the temp directory
+  static std::filesystem::path default_directory() {
+    std::error_code ec;
+    auto temp = std::filesystem::temp_directory_path(ec);
+    return (ec ? std::filesystem::path{"."} : temp) / "kbrdhook-samples";
+  }
+
+  // the decoded samples of source, valid until the cache is destroyed. empty
+  // when the source cannot be read or decoded.
+  std::span<const float> load(const std::filesystem::path& source) {
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(source, ec)) {
+      return {};
+    }
+    auto h = expected_header(source);
+    char suffix[24];
+    snprintf(
+        suffix,
+        sizeof(suffix),
+        "-%016llx.pcm",
+        static_cast<unsigned long long>(h.sourcePath_));
+    auto path = directory_ / source.filename();
+    path += suffix;
+
+    // the usual case, a single mmap
+    if (auto cached = map(path, h); !cached.empty()) {
+      ++hits_;
+      return cached;
+    }
+
+    ++misses_;
+    auto decoded = decode(source, sampleRate_);
+    if (!decoded || decoded->empty()) {
+      return {};
+    }
+    h.frames_ = decoded->size();
+    std::filesystem::create_directories(directory_, ec);
+    if (write_cache(path, h, *decoded)) {
+      if (auto cached = map(path, h); !cached.empty()) {
+        return cached;
+      }
+    }
+    // the cache directory is not writable. keep the decoded copy for this run.
+    return unmapped_.emplace_back(std::move(*decoded));
+  }
+
+  // loads that mapped an existing cache file
+  std::size_t hits() const noexcept { return hits_; }
+  // loads that had to decode the source
+  std::size_t misses() const noexcept { return misses_; }
+};
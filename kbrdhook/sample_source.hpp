@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#if defined(_WIN32)
+#  include <windows.h>
+#  include <mfapi.h>
+#  include <mfidl.h>
+#  include <mfreadwrite.h>
+#  pragma comment(lib, "mfplat.lib")
+#  pragma comment(lib, "mfreadwrite.lib")
+#  pragma comment(lib, "mfuuid.lib")
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// samples for the mixer: mono float at the mixer sample rate
+
+// a short decaying noise burst, for when no recorded click is available
+inline std::vector<float> synthesize_click(std::uint32_t sampleRate) {
+  const auto frames = sampleRate / 50;  // 20ms
+  const auto decay = 0.002f * sampleRate;
+  std::vector<float> samples(frames);
+  std::uint32_t noise = 0x12345678;
+  for (std::uint32_t i = 0; i < frames; ++i) {
+    noise = noise * 1664525u + 1013904223u;
+    auto white = float(noise >> 8) / float(1u << 24) * 2.0f - 1.0f;
+    samples[i] = 0.5f * white * std::exp(-float(i) / decay);
+  }
+  return samples;
+}
+
+#if defined(_WIN32)
+// decode the audio at url with the media foundation source reader, which
+// also converts it to mono float at sampleRate. returns the HRESULT of the
+// first step that failed.
+inline HRESULT decode_with_media_foundation(
+    PCWSTR url, std::uint32_t sampleRate, std::vector<float>& samples) {
+  samples.clear();
+  IMFSourceReader* reader = nullptr;
+  IMFMediaType* type = nullptr;
+  HRESULT hr = MFCreateSourceReaderFromURL(url, NULL, &reader);
+  if (SUCCEEDED(hr)) {
+    hr = MFCreateMediaType(&type);
+  }
+  if (SUCCEEDED(hr)) {
+    type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+    type->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_Float);
+    type->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS, 1);
+    type->SetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, sampleRate);
+    type->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, 32);
+    type->SetUINT32(MF_MT_AUDIO_BLOCK_ALIGNMENT, sizeof(float));
+    type->SetUINT32(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, sampleRate * 4);
+    hr = reader->SetCurrentMediaType(
+        DWORD(MF_SOURCE_READER_FIRST_AUDIO_STREAM), NULL, type);
+  }
+  while (SUCCEEDED(hr)) {
+    DWORD flags = 0;
+    IMFSample* sample = nullptr;
+    hr = reader->ReadSample(
+        DWORD(MF_SOURCE_READER_FIRST_AUDIO_STREAM),
+        0,
+        NULL,
+        &flags,
+        NULL,
+        &sample);
+    if (FAILED(hr) || (flags & MF_SOURCE_READERF_ENDOFSTREAM)) {
+      if (!!sample) {
+        sample->Release();
+      }
+      break;
+    }
+    if (!sample) {
+      continue;
+    }
+    IMFMediaBuffer* buffer = nullptr;
+    hr = sample->ConvertToContiguousBuffer(&buffer);
+    if (SUCCEEDED(hr)) {
+      BYTE* data = nullptr;
+      DWORD length = 0;
+      hr = buffer->Lock(&data, NULL, &length);
+      if (SUCCEEDED(hr)) {
+        auto* first = reinterpret_cast<const float*>(data);
+        samples.insert(samples.end(), first, first + length / sizeof(float));
+        buffer->Unlock();
+      }
+      buffer->Release();
+    }
+    sample->Release();
+  }
+  if (!!type) {
+    type->Release();
+  }
+  if (!!reader) {
+    reader->Release();
+  }
+  return hr;
+}
+#endif
@@ -22,12 +22,28 @@
 #include <unifex/scheduler_concepts.hpp>
 #include <unifex/sender_concepts.hpp>
 #include <unifex/sender_concepts.hpp>
+#include <unifex/typed_via.hpp>
 #include <unifex/unstoppable_token.hpp>
 
+#include "broadcast_ring.hpp"
+#include "event_ring.hpp"
+#include "trace.hpp"
+
+#include <array>
+#include <atomic>
 #include <optional>
 #include <ranges>
+#include <span>
+#include <utility>
 
 namespace detail {
+template <typename EventBuffer>
+inline constexpr std::size_t broadcast_subscribers = 0;
+template <typename EventBuffer>
+requires requires { EventBuffer::max_subscribers; }
+inline constexpr std::size_t broadcast_subscribers<EventBuffer> =
+    EventBuffer::max_subscribers;
+
 // _conv needed so we can emplace construct non-movable types into
 // a std::optional.
 template <typename F>
@@ -42,33 +58,138 @@ template <
     typename EventType,
     typename RangeStopToken,
     typename RegisterFn,
-    typename UnregisterFn>
+    typename UnregisterFn,
+    typename EventBuffer = no_event_buffer>
 struct sender_range {
+  // a broadcast_ring delivers every event to every subscriber
+  static inline constexpr bool is_broadcast =
+      requires { EventBuffer::max_subscribers; };
+  static inline constexpr bool is_buffered =
+      !std::is_same_v<EventBuffer, no_event_buffer> && !is_broadcast;
+
   using complete_function_t = void (*)(void*, EventType*) noexcept;
+  using complete_batch_function_t =
+      void (*)(void*, std::span<EventType>) noexcept;
 
   struct pending_operation {
     void* pendingOperation_;
     complete_function_t complete_with_event_;
+    // only set for senders from batches()
+    complete_batch_function_t complete_with_batch_{nullptr};
 
     void operator()(EventType* e) {
       std::exchange(complete_with_event_, nullptr)(
           std::exchange(pendingOperation_, nullptr), e);
     };
 
+    void operator()(std::span<EventType> batch) {
+      complete_with_event_ = nullptr;
+      std::exchange(complete_with_batch_, nullptr)(
+          std::exchange(pendingOperation_, nullptr), batch);
+    };
+
     pending_operation* next_{nullptr};
   };
 
+  // a broadcast sender_range is consumed through subscribe()
   template <typename State>
-  void start(State* state) noexcept {
+  void start(State* state) noexcept requires(!is_broadcast) {
     if (rangeToken_.stop_requested() ||
         state->eventStopToken_.stop_requested()) {
       unifex::set_done(std::move(state->rec_));
     } else {
       (void)pendingOperations_.enqueue(&state->pending_);
+      if (stop_raced()) {
+        return;
+      }
+      if constexpr (is_buffered) {
+        deliver_buffered();
+      }
+    }
+  }
+
+  // a stop that ran while a pending operation was out of the queue found
+  // nothing to complete. called after putting it in the queue, this
+  // completes it if the range has stopped since.
+  bool stop_raced() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!rangeToken_.stop_requested()) {
+      return false;
+    }
+    stop_pending();
+    return true;
+  }
+
+  // hand buffered events to the pending operation until one of them runs
+  // out.
+  //
+  // both dispatch() and start() call this after publishing their side (the
+  // event or the pending operation) so that whichever runs second sees the
+  // other and no event is left in the buffer while a sender is waiting.
+  void deliver_buffered() {
+    for (;;) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!eventBuffer_.ready()) {
+        return;
+      }
+
+      auto pending = pendingOperations_.dequeue_all();
+      if (pending.empty()) {
+        // the next sender to start will take the event
+        return;
+      }
+
+      auto& complete = *pending.pop_front();
+      if (!pending.empty()) {
+        // more than one pending operation - bug in sender_range usage
+        std::terminate();
+      }
+
+      if (!!complete.complete_with_batch_) {
+        // everything buffered since the last batch (batch_ is reused once
+        // the next sender from batches() starts)
+        auto count = eventBuffer_.pop_into(batch_);
+        if (count > 0) {
+          complete(std::span<EventType>{batch_.data(), count});
+          return;
+        }
+      } else if (auto event = eventBuffer_.try_pop()) {
+        complete(&event.value());
+        return;
+      }
+
+      // another thread took the event first (drop_oldest pops from the
+      // producer), put the operation back and check again
+      (void)pendingOperations_.enqueue(&complete);
+      if (stop_raced()) {
+        return;
+      }
     }
   }
 
   void dispatch(EventType* event) {
+    KBRDHOOK_TRACE(trace_stage::dispatch, event);
+    if constexpr (is_buffered) {
+      if (!!event) {
+        (void)eventBuffer_.push(std::move(*event));
+        deliver_buffered();
+        return;
+      }
+    }
+    if constexpr (is_broadcast) {
+      if (!!event) {
+        (void)eventBuffer_.publish(std::move(*event));
+        for (auto& s : subscribers_) {
+          s.deliver();
+        }
+      } else {
+        for (auto& s : subscribers_) {
+          s.stop_pending();
+        }
+      }
+      return;
+    }
+
     auto pending = pendingOperations_.dequeue_all();
 
     if (pending.empty()) {
@@ -99,33 +220,53 @@ struct sender_range {
 
   using registration_t = unifex::callable_result_t<RegisterFn, event_function&>;
 
-  struct create_sender {
+  // Batch == true produces the senders for batches(), which complete with
+  // all the events that were buffered since the previous batch
+  template <bool Batch>
+  struct basic_create_sender {
+    using value_t = std::conditional_t<Batch, std::span<EventType>, EventType>;
+
     template <
         template <typename...>
         class Variant,
         template <typename...>
         class Tuple>
-    using value_types = Variant<Tuple<EventType>>;
+    using value_types = Variant<Tuple<value_t>>;
 
     template <template <typename...> class Variant>
     using error_types = Variant<std::exception_ptr>;
 
     static inline constexpr bool sends_done = true;
 
-    template <typename Receiver, typename EventStopToken>
+    template <typename Receiver, typename EventStopToken, typename Source>
     struct state {
       static void
       _complete_with_event(void* selfVoid, EventType* event) noexcept {
         auto& self = *reinterpret_cast<state*>(selfVoid);
-        if (!!event) {
-          unifex::set_value(std::move(self.rec_), std::move(*event));
-        } else {
-          unifex::set_done(std::move(self.rec_));
+        if constexpr (!Batch) {
+          if (!!event) {
+            if constexpr (std::is_same_v<Source, sender_range>) {
+              unifex::set_value(std::move(self.rec_), std::move(*event));
+            } else {
+              // the event is shared with the other subscribers
+              unifex::set_value(std::move(self.rec_), std::as_const(*event));
+            }
+            return;
+          }
+        }
+        unifex::set_done(std::move(self.rec_));
+      }
+
+      static void _complete_with_batch(
+          void* selfVoid, std::span<EventType> batch) noexcept {
+        auto& self = *reinterpret_cast<state*>(selfVoid);
+        if constexpr (Batch) {
+          unifex::set_value(std::move(self.rec_), batch);
         }
       }
 
       // args
-      sender_range* range_;
+      Source* range_;
       Receiver& rec_;
       EventStopToken eventStopToken_;
 
@@ -135,37 +276,114 @@ struct sender_range {
 
       // cancellation of the pending sender
       struct stop_callback {
-        sender_range* range_;
+        Source* range_;
         void operator()() noexcept { range_->stop_pending(); }
       };
       typename EventStopToken::template callback_type<stop_callback> callback_;
 
-      state(sender_range* scope, Receiver& rec, EventStopToken eventStopToken)
+      state(Source* scope, Receiver& rec, EventStopToken eventStopToken)
         : range_(scope)
         , rec_(rec)
         , eventStopToken_(eventStopToken)
-        , pending_({this, &_complete_with_event})
+        , pending_(
+              {this,
+               &_complete_with_event,
+               Batch ? &_complete_with_batch : nullptr})
         , callback_(eventStopToken_, stop_callback{range_}) {
         range_->start(this);
       }
       state(state&&) = delete;
     };
 
-    template <typename Receiver>
+    template <typename Receiver, typename Source>
     requires unifex::
         is_callable_v<unifex::tag_t<unifex::get_stop_token>, Receiver>
-    state<Receiver, unifex::stop_token_type_t<Receiver>>
-    operator()(Receiver& rec, sender_range* scope) noexcept {
+    state<Receiver, unifex::stop_token_type_t<Receiver>, Source>
+    operator()(Receiver& rec, Source* scope) noexcept {
       return {scope, rec, unifex::get_stop_token(rec)};
     }
 
-    template <typename Receiver>
+    template <typename Receiver, typename Source>
     requires (!unifex::is_callable_v<unifex::tag_t<unifex::get_stop_token>, Receiver>)
-    state<Receiver, unifex::unstoppable_token>
-    operator()(Receiver& rec, sender_range* scope) noexcept {
+    state<Receiver, unifex::unstoppable_token, Source>
+    operator()(Receiver& rec, Source* scope) noexcept {
       return {scope, rec, unifex::unstoppable_token{}};
     }
   };
+  using create_sender = basic_create_sender<false>;
+  using create_batch_sender = basic_create_sender<true>;
+
+  // one consumer of a broadcast sender_range. each subscriber has a single
+  // pending operation slot and its own cursor into the shared buffer, so
+  // subscribers never wait on each other's senders.
+  struct subscriber {
+    sender_range* range_{nullptr};
+    std::size_t id_{0};
+    std::atomic<pending_operation*> pending_{nullptr};
+    // the last event delivered is still in use by the consumer. it is
+    // released when the next sender starts.
+    bool holding_{false};
+
+    template <typename State>
+    void start(State* state) noexcept {
+      if (std::exchange(holding_, false)) {
+        range_->eventBuffer_.release(id_);
+      }
+      if (range_->rangeToken_.stop_requested() ||
+          state->eventStopToken_.stop_requested()) {
+        unifex::set_done(std::move(state->rec_));
+        return;
+      }
+      if (pending_.exchange(&state->pending_) != nullptr) {
+        // more than one pending operation - bug in subscription usage
+        std::terminate();
+      }
+      if (stop_raced()) {
+        return;
+      }
+      deliver();
+    }
+
+    // like sender_range::stop_raced(), for the single slot
+    bool stop_raced() {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!range_->rangeToken_.stop_requested()) {
+        return false;
+      }
+      stop_pending();
+      return true;
+    }
+
+    // same handshake as deliver_buffered(), with a single slot instead of
+    // a queue
+    void deliver() {
+      for (;;) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!range_->eventBuffer_.ready(id_)) {
+          return;
+        }
+        auto* complete = pending_.exchange(nullptr);
+        if (!complete) {
+          return;
+        }
+        if (auto* event = range_->eventBuffer_.peek(id_)) {
+          holding_ = true;
+          (*complete)(event);
+          return;
+        }
+        pending_.store(complete);
+        if (stop_raced()) {
+          return;
+        }
+      }
+    }
+
+    void stop_pending() {
+      if (auto* complete = pending_.exchange(nullptr)) {
+        (*complete)(static_cast<EventType*>(nullptr));
+      }
+    }
+  };
 
   struct stop_callback {
     sender_range* range_;
@@ -179,10 +397,25 @@ struct sender_range {
              return unifex::create(create_sender{}, self);
            });
   }
+  static auto make_batch_range(sender_range* self) {
+    return std::views::iota(0) | std::views::transform([self](int) {
+             return unifex::create(create_batch_sender{}, self);
+           });
+  }
+
+  template <typename Range>
+  struct sender_view {
+    Range* range_;
+
+    auto begin() { return range_->begin(); }
+    auto end() { return range_->end(); }
+  };
 
   // storage for underlying range that produces senders
   using RangeType = decltype(make_range(nullptr));
   RangeType range_;
+  using BatchRangeType = decltype(make_batch_range(nullptr));
+  BatchRangeType batchRange_;
   // args
   RangeStopToken rangeToken_;
   RegisterFn registerFn_;
@@ -194,6 +427,14 @@ struct sender_range {
   // type-erased registration of a sender waiting for an event
   unifex::atomic_intrusive_queue<pending_operation, &pending_operation::next_>
       pendingOperations_;
+  // holds events that arrive while no sender is pending (unused for
+  // no_event_buffer)
+  [[no_unique_address]] EventBuffer eventBuffer_;
+  // the events delivered by the last sender from batches()
+  std::array<EventType, is_buffered ? EventBuffer::capacity : 0> batch_;
+  // one slot per possible subscriber (only used by broadcast_ring)
+  std::array<subscriber, detail::broadcast_subscribers<EventBuffer>>
+      subscribers_;
   // fixed storage for the fucntion used to emit an event (allows
   // event_function& to have the right lifetime)
   event_function event_function_;
@@ -204,8 +445,20 @@ struct sender_range {
     }};
   }
 
+  void _init_subscribers() noexcept {
+    for (std::size_t id = 0; id < subscribers_.size(); ++id) {
+      subscribers_[id].range_ = this;
+      subscribers_[id].id_ = id;
+    }
+  }
+
   void _unregister() {
     if (!!registration_) {
+      if constexpr (is_buffered || is_broadcast) {
+        // release a producer blocked on a full buffer before waiting for
+        // the source to stop
+        eventBuffer_.close();
+      }
       unregisterFn_(registration_.value());
       registration_.reset();
       stop_pending();
@@ -216,28 +469,104 @@ public:
   sender_range(
       RangeStopToken token, RegisterFn registerFn, UnregisterFn unregisterFn)
     : range_(make_range(this))
+    , batchRange_(make_batch_range(this))
+    , rangeToken_(token)
+    , registerFn_(registerFn)
+    , unregisterFn_(unregisterFn)
+    , callback_(rangeToken_, stop_callback{this})
+    , registration_(_register())
+    , pendingOperations_()
+    , eventBuffer_()
+    , event_function_(this) {
+    _init_subscribers();
+  }
+  sender_range(
+      RangeStopToken token,
+      overflow_policy policy,
+      RegisterFn registerFn,
+      UnregisterFn unregisterFn) requires(is_buffered || is_broadcast)
+    : range_(make_range(this))
+    , batchRange_(make_batch_range(this))
     , rangeToken_(token)
     , registerFn_(registerFn)
     , unregisterFn_(unregisterFn)
     , callback_(rangeToken_, stop_callback{this})
     , registration_(_register())
     , pendingOperations_()
-    , event_function_(this) {}
+    , eventBuffer_(policy)
+    , event_function_(this) {
+    _init_subscribers();
+  }
   sender_range(sender_range&&) = delete;
   ~sender_range() noexcept { _unregister(); }
 
-  auto view() {
-    struct sender_view {
-      RangeType* range_;
+  // owns a subscriber slot of a broadcast sender_range. every subscription
+  // receives every event published after it was created.
+  //
+  // the producer only completes the pending sender, the senders from view()
+  // then resume the consumer on the subscription's scheduler. so a slow
+  // subscriber holds up neither the producer thread nor the other
+  // subscribers (until the buffer is full).
+  template <typename Scheduler>
+  class subscription {
+    subscriber* subscriber_;
+    Scheduler scheduler_;
+
+  public:
+    subscription(subscriber* s, Scheduler scheduler) noexcept
+      : subscriber_(s)
+      , scheduler_(std::move(scheduler)) {}
+    subscription(subscription&&) = delete;
+    ~subscription() {
+      subscriber_->stop_pending();
+      subscriber_->holding_ = false;
+      subscriber_->range_->eventBuffer_.unsubscribe(subscriber_->id_);
+    }
 
-      auto begin() { return range_->begin(); }
-      auto end() { return range_->end(); }
-    };
-    return sender_view{&range_};
+    auto view() {
+      return std::views::iota(0) |
+          std::views::transform([s = subscriber_, sch = scheduler_](int) {
+               return unifex::typed_via(
+                   unifex::create(create_sender{}, s), sch);
+             });
+    }
+  };
+
+  // an empty optional when all the subscriber slots are in use
+  template <typename Scheduler>
+  std::optional<subscription<Scheduler>>
+  subscribe(Scheduler scheduler) requires is_broadcast {
+    auto id = eventBuffer_.subscribe();
+    if (id == EventBuffer::max_subscribers) {
+      return std::nullopt;
+    }
+    return std::optional<subscription<Scheduler>>{
+        std::in_place, &subscribers_[id], std::move(scheduler)};
+  }
+
+  auto view() requires(!is_broadcast) { return sender_view<RangeType>{&range_}; }
+
+  // each sender completes with a span of every event buffered since the
+  // previous batch completed. the span is valid until the next sender from
+  // this view is started.
+  auto batches() requires is_buffered {
+    return sender_view<BatchRangeType>{&batchRange_};
   }
 
   auto& get_registration() { return registration_; }
 
+  // total number of events that passed through the buffer (every event
+  // that was not dropped, whether or not a sender was already pending)
+  std::size_t queued_events() const noexcept
+      requires(is_buffered || is_broadcast) {
+    return eventBuffer_.queued_count();
+  }
+  // total number of events discarded by the overflow policy
+  std::size_t dropped_events() const noexcept
+      requires(is_buffered || is_broadcast) {
+    return eventBuffer_.dropped_count();
+  }
+
   auto begin() noexcept { return range_.begin(); }
   auto end() noexcept { return range_.end(); }
 };
@@ -264,3 +593,80 @@ create_event_sender_range(
 
   return {token, (RegisterFn &&) registerFn, (UnregisterFn &&) unregisterFn};
 }
+
+template <
+    typename EventType,
+    std::size_t Capacity,
+    typename StopToken,
+    typename RegisterFn,
+    typename UnregisterFn>
+sender_range<
+    EventType,
+    StopToken,
+    RegisterFn,
+    UnregisterFn,
+    event_ring<EventType, Capacity>>
+create_buffered_event_sender_range(
+    StopToken token,
+    overflow_policy policy,
+    RegisterFn&& registerFn,
+    UnregisterFn&& unregisterFn) {
+  using result_t = sender_range<
+      EventType,
+      StopToken,
+      RegisterFn,
+      UnregisterFn,
+      event_ring<EventType, Capacity>>;
+  using registration_t =
+      unifex::callable_result_t<RegisterFn, typename result_t::event_function&>;
+
+  static_assert(
+      unifex::
+          is_nothrow_callable_v<RegisterFn, typename result_t::event_function&>,
+      "register function must be noexcept");
+  static_assert(
+      unifex::is_nothrow_callable_v<UnregisterFn, registration_t&>,
+      "unregister function must be noexcept");
+
+  return {
+      token, policy, (RegisterFn &&) registerFn, (UnregisterFn &&) unregisterFn};
+}
+
+template <
+    typename EventType,
+    std::size_t Capacity,
+    std::size_t MaxSubscribers,
+    typename StopToken,
+    typename RegisterFn,
+    typename UnregisterFn>
+sender_range<
+    EventType,
+    StopToken,
+    RegisterFn,
+    UnregisterFn,
+    broadcast_ring<EventType, Capacity, MaxSubscribers>>
+create_broadcast_event_sender_range(
+    StopToken token,
+    overflow_policy policy,
+    RegisterFn&& registerFn,
+    UnregisterFn&& unregisterFn) {
+  using result_t = sender_range<
+      EventType,
+      StopToken,
+      RegisterFn,
+      UnregisterFn,
+      broadcast_ring<EventType, Capacity, MaxSubscribers>>;
+  using registration_t =
+      unifex::callable_result_t<RegisterFn, typename result_t::event_function&>;
+
+  static_assert(
+      unifex::
+          is_nothrow_callable_v<RegisterFn, typename result_t::event_function&>,
+      "register function must be noexcept");
+  static_assert(
+      unifex::is_nothrow_callable_v<UnregisterFn, registration_t&>,
+      "unregister function must be noexcept");
+
+  return {
+      token, policy, (RegisterFn &&) registerFn, (UnregisterFn &&) unregisterFn};
+}
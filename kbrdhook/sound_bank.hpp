@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "key_event.hpp"
+#include "sample_cache.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+// groups of keys that share a sound
+enum class key_class : std::uint8_t {
+  other,
+  alphanumeric,
+  space,
+  enter,
+  modifier
+};
+inline constexpr std::size_t keyClassCount = 5;
+
+namespace detail {
+// virtual-key codes, spelled out so that this builds without windows.h
+constexpr key_class classify_key(std::uint32_t vkCode) noexcept {
+  if (vkCode == 0x20) {  // VK_SPACE
+    return key_class::space;
+  }
+  if (vkCode == 0x0D) {  // VK_RETURN
+    return key_class::enter;
+  }
+  if ((vkCode >= 0x10 && vkCode <= 0x12) ||  // VK_SHIFT..VK_MENU
+      vkCode == 0x14 ||                      // VK_CAPITAL
+      vkCode == 0x5B || vkCode == 0x5C ||    // VK_LWIN, VK_RWIN
+      (vkCode >= 0xA0 && vkCode <= 0xA5)) {  // VK_LSHIFT..VK_RMENU
+    return key_class::modifier;
+  }
+  if ((vkCode >= 0x30 && vkCode <= 0x39) ||  // '0'..'9'
+      (vkCode >= 0x41 && vkCode <= 0x5A) ||  // 'A'..'Z'
+      (vkCode >= 0x60 && vkCode <= 0x69)) {  // VK_NUMPAD0..VK_NUMPAD9
+    return key_class::alphanumeric;
+  }
+  return key_class::other;
+}
+}  // namespace detail
+
+// the class of every virtual-key code, built at compile time
+inline constexpr auto keyClassTable = []() {
+  std::array<key_class, 256> table{};
+  for (std::uint32_t vkCode = 0; vkCode < table.size(); ++vkCode) {
+    table[vkCode] = detail::classify_key(vkCode);
+  }
+  return table;
+}();
+
+static_assert(std::size_t(key_class::modifier) + 1 == keyClassCount);
+
+// representative keys, including both ends of every range
+static_assert(keyClassTable[0x20] == key_class::space);
+static_assert(keyClassTable[0x0D] == key_class::enter);
+static_assert(keyClassTable['0'] == key_class::alphanumeric);
+static_assert(keyClassTable['9'] == key_class::alphanumeric);
+static_assert(keyClassTable['A'] == key_class::alphanumeric);
+static_assert(keyClassTable['Z'] == key_class::alphanumeric);
+static_assert(keyClassTable[0x60] == key_class::alphanumeric);  // NUMPAD0
+static_assert(keyClassTable[0x69] == key_class::alphanumeric);  // NUMPAD9
+static_assert(keyClassTable[0x10] == key_class::modifier);      // SHIFT
+static_assert(keyClassTable[0x12] == key_class::modifier);      // MENU
+static_assert(keyClassTable[0x14] == key_class::modifier);      // CAPITAL
+static_assert(keyClassTable[0x5B] == key_class::modifier);      // LWIN
+static_assert(keyClassTable[0x5C] == key_class::modifier);      // RWIN
+static_assert(keyClassTable[0xA0] == key_class::modifier);      // LSHIFT
+static_assert(keyClassTable[0xA5] == key_class::modifier);      // RMENU
+// just outside the ranges
+static_assert(keyClassTable[0x00] == key_class::other);
+static_assert(keyClassTable[0x08] == key_class::other);  // BACK
+static_assert(keyClassTable[0x13] == key_class::other);  // PAUSE
+static_assert(keyClassTable[0x1B] == key_class::other);  // ESCAPE
+static_assert(keyClassTable[0x2F] == key_class::other);  // HELP
+static_assert(keyClassTable[0x3A] == key_class::other);
+static_assert(keyClassTable[0x40] == key_class::other);
+static_assert(keyClassTable[0x5D] == key_class::other);  // APPS
+static_assert(keyClassTable[0x6A] == key_class::other);  // MULTIPLY
+static_assert(keyClassTable[0x9F] == key_class::other);
+static_assert(keyClassTable[0xA6] == key_class::other);  // BROWSER_BACK
+static_assert(keyClassTable[0xFF] == key_class::other);
+
+// a sample for each key class. picking the sample for a key is two
+// indexed loads, with no lookups or branches.
+class sound_bank {
+  std::array<std::span<const float>, keyClassCount> samples_{};
+
+public:
+  // the file for each key class, in key_class order. classes without a file
+  // use the sample for key_class::other.
+  static inline constexpr std::array<const char*, keyClassCount> fileNames{
+      "click.wav", "alphanumeric.wav", "space.wav", "enter.wav",
+      "modifier.wav"};
+
+  // load the samples in directory through the cache. fallback is used when
+  // there is no click.wav. the samples must outlive the bank.
+  void load(
+      sample_cache& cache,
+      const std::filesystem::path& directory,
+      std::span<const float> fallback) {
+    auto& defaultSample = samples_[0];
+    defaultSample = cache.load(directory / fileNames[0]);
+    if (defaultSample.empty()) {
+      defaultSample = fallback;
+    }
+    for (std::size_t i = 1; i < keyClassCount; ++i) {
+      samples_[i] = cache.load(directory / fileNames[i]);
+      if (samples_[i].empty()) {
+        samples_[i] = defaultSample;
+      }
+    }
+  }
+
+  std::span<const float> sample_for(key_class c) const noexcept {
+    return samples_[static_cast<std::size_t>(c)];
+  }
+  std::span<const float> sample_for(const key_event& event) const noexcept {
+    return sample_for(keyClassTable[event.vkCode_ & 0xFF]);
+  }
+};
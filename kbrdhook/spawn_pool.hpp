@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <unifex/async_manual_reset_event.hpp>
+#include <unifex/just_from.hpp>
+#include <unifex/receiver_concepts.hpp>
+#include <unifex/scheduler_concepts.hpp>
+#include <unifex/sender_concepts.hpp>
+#include <unifex/sequence.hpp>
+#include <unifex/then.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <utility>
+
+// a replacement for unifex::async_scope::spawn_call_on() that never
+// allocates. each spawned operation is constructed in one of Capacity
+// preallocated slots taken from a lock-free freelist.
+//
+// when every slot is in use the new work is dropped and counted, and
+// spawn_call_on() returns false. dropping is the right policy for clicks -
+// by the time a slot frees up the click would be late anyway.
+template <std::size_t Capacity, std::size_t SlotSize = 256>
+class spawn_pool {
+  static_assert(Capacity > 0 && Capacity < UINT32_MAX);
+
+  struct slot {
+    alignas(std::max_align_t) unsigned char storage_[SlotSize];
+    void (*destroy_)(slot*) noexcept {nullptr};
+    std::atomic<std::uint32_t> next_{0};
+  };
+  static inline constexpr std::uint32_t none = UINT32_MAX;
+
+  std::array<slot, Capacity> slots_;
+  // the index of the first free slot in the low half. the high half counts
+  // changes, so that a pop that raced with a pop and a push of the same
+  // slot fails its compare_exchange.
+  std::atomic<std::uint64_t> free_;
+  // spawned operations that have not completed, plus one until complete()
+  std::atomic<std::size_t> outstanding_{1};
+  std::atomic<bool> closed_{false};
+  std::atomic<std::size_t> dropped_{0};
+  unifex::async_manual_reset_event drained_;
+
+  static std::uint64_t
+  retag(std::uint64_t previous, std::uint32_t index) noexcept {
+    return (((previous >> 32) + 1) << 32) | index;
+  }
+
+  slot* pop() noexcept {
+    auto head = free_.load(std::memory_order_acquire);
+    for (;;) {
+      auto index = static_cast<std::uint32_t>(head);
+      if (index == none) {
+        return nullptr;
+      }
+      auto next = slots_[index].next_.load(std::memory_order_relaxed);
+      if (free_.compare_exchange_weak(
+              head,
+              retag(head, next),
+              std::memory_order_acquire,
+              std::memory_order_acquire)) {
+        return &slots_[index];
+      }
+    }
+  }
+
+  void push(slot* s) noexcept {
+    auto index = static_cast<std::uint32_t>(s - slots_.data());
+    auto head = free_.load(std::memory_order_relaxed);
+    do {
+      s->next_.store(
+          static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+    } while (!free_.compare_exchange_weak(
+        head,
+        retag(head, index),
+        std::memory_order_release,
+        std::memory_order_relaxed));
+  }
+
+  void unreference() noexcept {
+    if (outstanding_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      drained_.set();
+    }
+  }
+
+  void release(slot* s) noexcept {
+    s->destroy_(s);
+    push(s);
+    unreference();
+  }
+
+  struct receiver {
+    spawn_pool* pool_;
+    slot* slot_;
+
+    void set_value() noexcept { pool_->release(slot_); }
+    void set_done() noexcept { pool_->release(slot_); }
+    template <typename Error>
+    [[noreturn]] void set_error(Error&&) noexcept {
+      std::terminate();
+    }
+  };
+
+public:
+  spawn_pool() noexcept {
+    for (std::uint32_t i = 0; i < Capacity; ++i) {
+      slots_[i].next_.store(i + 1 < Capacity ? i + 1 : none);
+    }
+    free_.store(0);
+  }
+  spawn_pool(const spawn_pool&) = delete;
+  ~spawn_pool() {
+    if (outstanding_.load() != 0) {
+      // must complete()
+      std::terminate();
+    }
+  }
+
+  static inline constexpr std::size_t capacity = Capacity;
+
+  // run fn on scheduler. returns false if the work was dropped because the
+  // pool was full or already completing.
+  template <typename Scheduler, typename Fn>
+  bool spawn_call_on(Scheduler&& scheduler, Fn&& fn) noexcept {
+    using sender_t = decltype(unifex::then(
+        unifex::schedule((Scheduler &&) scheduler), (Fn &&) fn));
+    using op_t = unifex::connect_result_t<sender_t, receiver>;
+    static_assert(
+        sizeof(op_t) <= SlotSize, "increase the SlotSize of the spawn_pool");
+    static_assert(alignof(op_t) <= alignof(std::max_align_t));
+
+    // count first so that complete() cannot finish in between
+    outstanding_.fetch_add(1, std::memory_order_acq_rel);
+    slot* s = closed_.load(std::memory_order_acquire) ? nullptr : pop();
+    if (!s) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      unreference();
+      return false;
+    }
+    auto* op = ::new (static_cast<void*>(s->storage_)) op_t(unifex::connect(
+        unifex::then(unifex::schedule((Scheduler &&) scheduler), (Fn &&) fn),
+        receiver{this, s}));
+    s->destroy_ = [](slot* s) noexcept {
+      std::launder(reinterpret_cast<op_t*>(s->storage_))->~op_t();
+    };
+    unifex::start(*op);
+    return true;
+  }
+
+  // stop taking new work and complete when the spawned work has completed
+  [[nodiscard]] auto complete() {
+    return unifex::sequence(
+        unifex::just_from([this]() noexcept {
+          if (!closed_.exchange(true, std::memory_order_acq_rel)) {
+            unreference();
+          }
+        }),
+        drained_.async_wait());
+  }
+
+  // spawned operations that have not completed yet
+  std::size_t in_use() const noexcept {
+    auto outstanding = outstanding_.load(std::memory_order_relaxed);
+    return closed_.load(std::memory_order_relaxed) ? outstanding
+                                                   : outstanding - 1;
+  }
+  // work that was not run because no slot was free
+  std::size_t dropped() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+};
@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/just_from.hpp>
+#include <unifex/sender_concepts.hpp>
+
+#include "event_ring.hpp"
+#include "key_event.hpp"
+#include "sender_range.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// when a synthetic source emits its events
+struct synthetic_schedule {
+  using clock_t = std::chrono::steady_clock;
+  using duration_t = clock_t::duration;
+
+  enum class shape { constant, poisson, bursts };
+
+  // events_ in a row spacing_ apart, then pause_ before the next burst
+  struct burst {
+    std::size_t events_;
+    duration_t spacing_;
+    duration_t pause_;
+  };
+
+  shape shape_{shape::constant};
+  // across all producers, for constant and poisson
+  double eventsPerSecond_{1000.0};
+  // replayed in order, in a loop, by every producer
+  std::vector<burst> bursts_;
+  std::size_t producers_{1};
+  // across all producers. 0 runs until the source is destroyed.
+  std::uint64_t totalEvents_{0};
+  std::uint64_t seed_{1};
+
+  static synthetic_schedule constant(
+      double eventsPerSecond,
+      std::size_t producers = 1,
+      std::uint64_t totalEvents = 0) {
+    return {shape::constant, eventsPerSecond, {}, producers, totalEvents};
+  }
+  // exponentially distributed gaps with the given mean rate
+  static synthetic_schedule poisson(
+      double eventsPerSecond,
+      std::size_t producers = 1,
+      std::uint64_t totalEvents = 0) {
+    return {shape::poisson, eventsPerSecond, {}, producers, totalEvents};
+  }
+  static synthetic_schedule recorded(
+      std::vector<burst> bursts,
+      std::size_t producers = 1,
+      std::uint64_t totalEvents = 0) {
+    return {shape::bursts, 0.0, std::move(bursts), producers, totalEvents};
+  }
+
+  // at least one producer, and a pace for each of them: a rate whose gap
+  // between events fits in a duration_t, or bursts of at least one event
+  bool valid() const noexcept {
+    if (producers_ == 0) {
+      return false;
+    }
+    switch (shape_) {
+      case shape::constant:
+      case shape::poisson:
+        return eventsPerSecond_ > 0.0 &&
+            double(producers_) / eventsPerSecond_ <
+            std::chrono::duration<double>(duration_t::max()).count();
+      case shape::bursts:
+        return !bursts_.empty() &&
+            std::all_of(bursts_.begin(), bursts_.end(), [](const burst& b) {
+                 return b.events_ > 0;
+               });
+    }
+    return false;
+  }
+};
+
+// the event for a producer's sequence'th emit
+template <typename EventType>
+using make_synthetic_event_t =
+    EventType (*)(std::size_t producer, std::uint64_t sequence) noexcept;
+
+// cycles through the letters
+inline key_event
+synthetic_key_event(std::size_t, std::uint64_t sequence) noexcept {
+  return key_event{0x0100, std::uint32_t('A' + sequence % 26)};
+}
+
+// the registration returned by the register function. start() launches
+// one thread per producer, each calling fn_ on its own schedule.
+template <typename Fn, typename EventType>
+struct _synthetic_source {
+  using clock_t = synthetic_schedule::clock_t;
+
+  Fn& fn_;
+  synthetic_schedule schedule_;
+  make_synthetic_event_t<EventType> make_;
+  std::atomic<bool> stop_{false};
+  std::atomic<std::uint64_t> emitted_{0};
+  std::vector<std::thread> producers_;
+
+  _synthetic_source(
+      Fn& fn,
+      synthetic_schedule schedule,
+      make_synthetic_event_t<EventType> make)
+    : fn_(fn)
+    , schedule_(std::move(schedule))
+    , make_(make) {}
+  ~_synthetic_source() {
+    if (!producers_.empty()) {
+      // must call destroy()
+      std::terminate();
+    }
+  }
+
+  // sleep for long waits, spin for short ones so that rates up to millions
+  // per second are met. returns false if the source is stopping.
+  bool wait_until(clock_t::time_point next) noexcept {
+    using namespace std::literals::chrono_literals;
+    for (;;) {
+      if (stop_.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      auto now = clock_t::now();
+      if (now >= next) {
+        return true;
+      }
+      if (next - now > 200us) {
+        std::this_thread::sleep_for(std::min<clock_t::duration>(
+            next - now - 100us, std::chrono::milliseconds(10)));
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void produce(std::size_t producer) noexcept {
+    const auto producers = schedule_.producers_;
+    const auto total = schedule_.totalEvents_;
+    const auto quota = total == 0
+        ? UINT64_MAX
+        : total / producers + (producer < total % producers ? 1 : 0);
+    const double rate = schedule_.eventsPerSecond_ / producers;
+
+    std::mt19937_64 random{schedule_.seed_ + producer};
+    std::exponential_distribution<double> gaps{rate > 0.0 ? rate : 1.0};
+    std::size_t burstIndex = 0;
+    std::size_t inBurst = 0;
+
+    auto next = clock_t::now();
+    for (std::uint64_t sequence = 0; sequence < quota; ++sequence) {
+      if (!wait_until(next)) {
+        return;
+      }
+      auto event = make_(producer, sequence);
+      fn_(event);
+      emitted_.fetch_add(1, std::memory_order_relaxed);
+
+      // when falling behind, the following events go out back to back
+      // until the schedule is met again
+      switch (schedule_.shape_) {
+        case synthetic_schedule::shape::constant:
+          next += std::chrono::duration_cast<clock_t::duration>(
+              std::chrono::duration<double>(1.0 / rate));
+          break;
+        case synthetic_schedule::shape::poisson:
+          next += std::chrono::duration_cast<clock_t::duration>(
+              std::chrono::duration<double>(gaps(random)));
+          break;
+        case synthetic_schedule::shape::bursts: {
+          if (schedule_.bursts_.empty()) {
+            return;
+          }
+          auto& b = schedule_.bursts_[burstIndex];
+          if (++inBurst < b.events_) {
+            next += b.spacing_;
+          } else {
+            inBurst = 0;
+            burstIndex = (burstIndex + 1) % schedule_.bursts_.size();
+            next += b.pause_;
+          }
+        } break;
+      }
+    }
+  }
+
+  [[nodiscard]] auto start() {
+    return unifex::just_from([this]() {
+      if (!schedule_.valid()) {
+        fprintf(stderr, "synthetic_schedule has no producers or no pace\n");
+        std::terminate();
+      }
+      for (std::size_t i = 0; i < schedule_.producers_; ++i) {
+        producers_.emplace_back([this, i]() noexcept { produce(i); });
+      }
+    });
+  }
+
+  // stops and joins the producers
+  [[nodiscard]] auto destroy() {
+    return unifex::just_from([this]() noexcept { stop(); });
+  }
+
+  void stop() noexcept {
+    stop_.store(true, std::memory_order_relaxed);
+    for (auto& t : producers_) {
+      t.join();
+    }
+    producers_.clear();
+  }
+
+  std::uint64_t emitted() const noexcept {
+    return emitted_.load(std::memory_order_relaxed);
+  }
+};
+
+namespace detail {
+// the register and unregister functions for a sender_range fed by
+// synthetic producers, in the shape of detail::keyboard_events
+template <typename EventType>
+auto synthetic_events(
+    synthetic_schedule schedule, make_synthetic_event_t<EventType> make) {
+  auto register_ = [schedule = std::move(schedule), make](auto& fn) noexcept {
+    return _synthetic_source<std::remove_reference_t<decltype(fn)>, EventType>{
+        fn, schedule, make};
+  };
+  auto unregister_ = [](auto& source) noexcept {
+    // the producers must not call into a range that has unregistered
+    source.stop();
+  };
+  return std::make_pair(register_, unregister_);
+}
+}  // namespace detail
+
+// a stand-in for keyboard_hook that produces events on a schedule from its
+// own threads, for load tests and headless runs
+template <
+    typename EventType = key_event,
+    std::size_t Capacity = 1024,
+    typename StopToken = unifex::inplace_stop_token>
+class synthetic_event_source {
+  using fns = decltype(detail::synthetic_events<EventType>(
+      std::declval<synthetic_schedule>(),
+      std::declval<make_synthetic_event_t<EventType>>()));
+  using RangeType = sender_range<
+      EventType,
+      StopToken,
+      typename fns::first_type,
+      typename fns::second_type,
+      event_ring<EventType, Capacity>>;
+
+  unifex::inplace_stop_source stopSource_;
+  RangeType range_;
+
+  explicit synthetic_event_source(overflow_policy policy, fns functions)
+    : range_(
+          stopSource_.get_token(),
+          policy,
+          std::move(functions.first),
+          std::move(functions.second)) {}
+
+public:
+  explicit synthetic_event_source(
+      synthetic_schedule schedule,
+      make_synthetic_event_t<EventType> make,
+      overflow_policy policy = overflow_policy::drop_oldest)
+    : synthetic_event_source(
+          policy,
+          detail::synthetic_events<EventType>(std::move(schedule), make)) {}
+  explicit synthetic_event_source(
+      synthetic_schedule schedule,
+      overflow_policy policy = overflow_policy::drop_oldest)
+    requires std::is_same_v<EventType, key_event>
+    : synthetic_event_source(
+          std::move(schedule), &synthetic_key_event, policy) {}
+
+  unifex::inplace_stop_source& get_stop_source() { return stopSource_; }
+  void request_stop() { stopSource_.request_stop(); }
+
+  [[nodiscard]] auto start() { return range_.get_registration()->start(); }
+  // stops the range, which releases producers blocked on a full buffer (the
+  // consumer may already be gone) before joining them
+  [[nodiscard]] auto destroy() {
+    return unifex::just_from([this]() noexcept { request_stop(); });
+  }
+
+  auto events() { return range_.view(); }
+  auto batches() { return range_.batches(); }
+
+  // events handed to the range so far
+  std::uint64_t emitted() noexcept {
+    auto& registration = range_.get_registration();
+    return !!registration ? registration->emitted() : 0;
+  }
+  std::size_t queued_events() const noexcept { return range_.queued_events(); }
+  std::size_t dropped_events() const noexcept {
+    return range_.dropped_events();
+  }
+};
@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// latency tracing for the hops a keystroke takes from the hook to the
+// mixer. define KBRDHOOK_ENABLE_TRACING to turn it on. without it the
+// macros below expand to nothing and this header declares nothing else.
+//
+//   KBRDHOOK_TRACE_BEGIN(event)       stamp the event where it enters
+//   KBRDHOOK_TRACE(stage, event)      record the time since the last stamp
+//   KBRDHOOK_TRACE_END(stage, event)  also record the time since the begin
+//   KBRDHOOK_TRACE_DUMP(file)         print the histograms of every stage
+//
+// events carry their stamp in a trace_ member of type trace_stamp. trace
+// points on events without one do nothing.
+
+#if defined(KBRDHOOK_ENABLE_TRACING)
+
+#  include <algorithm>
+#  include <array>
+#  include <atomic>
+#  include <bit>
+#  include <chrono>
+#  include <cstddef>
+#  include <cstdint>
+#  include <cstdio>
+#  include <memory>
+#  include <mutex>
+
+enum class trace_stage : std::uint8_t {
+  // hook to sender_range::dispatch
+  dispatch,
+  // dispatch to clickety taking the event
+  resume,
+  // clickety to Player::Click spawning the click
+  spawn,
+  // the spawn to the click running on the click loop
+  click,
+  // hook to the click running
+  total
+};
+inline constexpr std::size_t traceStageCount = 5;
+
+inline const char* to_string(trace_stage stage) noexcept {
+  switch (stage) {
+    case trace_stage::dispatch:
+      return "hook to dispatch";
+    case trace_stage::resume:
+      return "dispatch to clickety";
+    case trace_stage::spawn:
+      return "clickety to spawn";
+    case trace_stage::click:
+      return "spawn to click";
+    case trace_stage::total:
+      return "hook to click";
+  }
+  return "unknown";
+}
+
+// carried by a traced event from one trace point to the next
+struct trace_stamp {
+  // steady clock nanoseconds, 0 when the event was never stamped
+  std::uint64_t begin_{0};
+  std::uint64_t last_{0};
+};
+
+// counts values in buckets that are at most 1/16th wide relative to their
+// value, like an HdrHistogram with one significant digit
+class latency_histogram {
+  static inline constexpr unsigned subBucketBits = 4;
+  static inline constexpr std::uint64_t subBuckets = 1u << subBucketBits;
+  static inline constexpr std::size_t bucketCount =
+      (64 - subBucketBits + 1) * subBuckets;
+
+  std::array<std::uint64_t, bucketCount> counts_{};
+  std::uint64_t count_{0};
+  std::uint64_t max_{0};
+
+  static std::size_t index_of(std::uint64_t value) noexcept {
+    if (value < subBuckets) {
+      return std::size_t(value);
+    }
+    unsigned top = 63 - unsigned(std::countl_zero(value));
+    auto sub = value >> (top - subBucketBits);
+    return std::size_t((top - subBucketBits + 1) * subBuckets) +
+        std::size_t(sub - subBuckets);
+  }
+  // the largest value counted in the bucket
+  static std::uint64_t highest_in(std::size_t index) noexcept {
+    if (index < subBuckets) {
+      return index;
+    }
+    auto magnitude = index / subBuckets;
+    auto sub = index % subBuckets + subBuckets;
+    return ((sub + 1) << (magnitude - 1)) - 1;
+  }
+
+public:
+  void record(std::uint64_t value) noexcept {
+    ++counts_[index_of(value)];
+    ++count_;
+    max_ = std::max(max_, value);
+  }
+
+  std::uint64_t count() const noexcept { return count_; }
+  std::uint64_t max() const noexcept { return max_; }
+
+  // p in [0, 1]
+  std::uint64_t percentile(double p) const noexcept {
+    if (count_ == 0) {
+      return 0;
+    }
+    auto rank = std::uint64_t(p * double(count_ - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucketCount; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(highest_in(i), max_);
+      }
+    }
+    return max_;
+  }
+};
+
+namespace detail {
+struct trace_sample {
+  std::uint64_t nanoseconds_;
+  trace_stage stage_;
+};
+
+// written only by the thread that owns it, drained by whichever thread
+// collects
+class trace_buffer {
+  static inline constexpr std::size_t capacity = 4096;
+
+  std::array<trace_sample, capacity> samples_;
+  alignas(64) std::atomic<std::uint64_t> head_{0};
+  alignas(64) std::atomic<std::uint64_t> tail_{0};
+  std::atomic<std::uint64_t> dropped_{0};
+
+public:
+  trace_buffer* next_{nullptr};
+
+  // returns false when the buffer is full
+  bool try_push(trace_sample sample) noexcept {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == capacity) {
+      return false;
+    }
+    samples_[head % capacity] = sample;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // more than half full, time to collect
+  bool filling() const noexcept {
+    return head_.load(std::memory_order_relaxed) -
+        tail_.load(std::memory_order_acquire) >
+        capacity / 2;
+  }
+
+  void drop() noexcept { dropped_.fetch_add(1, std::memory_order_relaxed); }
+
+  template <typename Fn>
+  void drain(Fn&& fn) noexcept {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    auto head = head_.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+      fn(samples_[tail % capacity]);
+    }
+    tail_.store(tail, std::memory_order_release);
+  }
+
+  std::uint64_t dropped() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+};
+
+// owns the buffer of every thread that has traced and the histograms they
+// are collected into
+class trace_registry {
+  std::atomic<trace_buffer*> buffers_{nullptr};
+  std::mutex lock_;
+  std::array<latency_histogram, traceStageCount> histograms_{};
+
+  // caller holds lock_
+  void collect_locked() noexcept {
+    for (auto* b = buffers_.load(std::memory_order_acquire); !!b;
+         b = b->next_) {
+      b->drain([this](const trace_sample& sample) noexcept {
+        histograms_[std::size_t(sample.stage_)].record(sample.nanoseconds_);
+      });
+    }
+  }
+
+public:
+  trace_registry() = default;
+  trace_registry(const trace_registry&) = delete;
+  ~trace_registry() {
+    auto* b = buffers_.exchange(nullptr);
+    while (!!b) {
+      std::unique_ptr<trace_buffer> owned{b};
+      b = b->next_;
+    }
+  }
+
+  static trace_registry& get() noexcept {
+    static trace_registry registry;
+    return registry;
+  }
+
+  trace_buffer& add() {
+    auto* buffer = new trace_buffer{};
+    buffer->next_ = buffers_.load(std::memory_order_relaxed);
+    while (!buffers_.compare_exchange_weak(
+        buffer->next_,
+        buffer,
+        std::memory_order_release,
+        std::memory_order_relaxed)) {
+    }
+    return *buffer;
+  }
+
+  // move the samples of every thread into the histograms. skipped when
+  // another thread is collecting, unless wait is true.
+  void collect(bool wait) noexcept {
+    std::unique_lock guard{lock_, std::defer_lock};
+    if (wait) {
+      guard.lock();
+    } else if (!guard.try_lock()) {
+      return;
+    }
+    collect_locked();
+  }
+
+  void dump(FILE* file) noexcept {
+    std::lock_guard guard{lock_};
+    collect_locked();
+    auto us = [](std::uint64_t ns) { return double(ns) / 1000.0; };
+    for (std::size_t s = 0; s < traceStageCount; ++s) {
+      auto& h = histograms_[s];
+      fprintf(
+          file,
+          "%-24s n=%-8llu p50=%10.3fus p99=%10.3fus p999=%10.3fus "
+          "max=%10.3fus\n",
+          to_string(trace_stage(s)),
+          static_cast<unsigned long long>(h.count()),
+          us(h.percentile(0.5)),
+          us(h.percentile(0.99)),
+          us(h.percentile(0.999)),
+          us(h.max()));
+    }
+    fprintf(
+        file,
+        "%-24s %llu\n",
+        "dropped samples",
+        static_cast<unsigned long long>(dropped()));
+    fflush(file);
+  }
+
+  // samples lost because a thread's buffer was full
+  std::uint64_t dropped() const noexcept {
+    std::uint64_t dropped = 0;
+    for (auto* b = buffers_.load(std::memory_order_acquire); !!b;
+         b = b->next_) {
+      dropped += b->dropped();
+    }
+    return dropped;
+  }
+};
+
+inline trace_buffer& local_trace_buffer() {
+  thread_local trace_buffer& buffer = trace_registry::get().add();
+  return buffer;
+}
+
+inline std::uint64_t trace_now() noexcept {
+  return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch())
+                           .count());
+}
+
+inline void trace_record(trace_stage stage, std::uint64_t ns) noexcept {
+  auto& buffer = local_trace_buffer();
+  if (!buffer.try_push(trace_sample{ns, stage})) {
+    // every collect since the buffer was half full was skipped, because
+    // another thread was collecting (and may have been preempted). wait for
+    // it instead of losing the sample.
+    trace_registry::get().collect(true);
+    if (!buffer.try_push(trace_sample{ns, stage})) {
+      buffer.drop();
+    }
+    return;
+  }
+  if (buffer.filling()) {
+    // fold the samples into the histograms before the buffer fills
+    trace_registry::get().collect(false);
+  }
+}
+
+template <typename EventType>
+inline constexpr bool is_traced =
+    requires(EventType& e) { e.trace_.begin_; };
+}  // namespace detail
+
+template <typename EventType>
+void trace_begin(EventType& event) noexcept {
+  if constexpr (detail::is_traced<EventType>) {
+    auto now = detail::trace_now();
+    event.trace_ = trace_stamp{now, now};
+  }
+}
+
+template <typename EventType>
+void trace_point(trace_stage stage, EventType& event) noexcept {
+  if constexpr (detail::is_traced<EventType>) {
+    if (event.trace_.begin_ == 0) {
+      return;
+    }
+    auto now = detail::trace_now();
+    detail::trace_record(stage, now - event.trace_.last_);
+    event.trace_.last_ = now;
+  }
+}
+template <typename EventType>
+void trace_point(trace_stage stage, EventType* event) noexcept {
+  if (!!event) {
+    trace_point(stage, *event);
+  }
+}
+
+template <typename EventType>
+void trace_end(trace_stage stage, EventType& event) noexcept {
+  if constexpr (detail::is_traced<EventType>) {
+    if (event.trace_.begin_ == 0) {
+      return;
+    }
+    trace_point(stage, event);
+    detail::trace_record(
+        trace_stage::total, event.trace_.last_ - event.trace_.begin_);
+  }
+}
+
+// print a histogram per stage of everything traced so far
+inline void trace_dump(FILE* file = stdout) noexcept {
+  detail::trace_registry::get().dump(file);
+}
+
+// the number of samples lost so far
+inline std::uint64_t trace_dropped() noexcept {
+  return detail::trace_registry::get().dropped();
+}
+
+#  define KBRDHOOK_TRACE_BEGIN(event) trace_begin(event)
+#  define KBRDHOOK_TRACE(stage, event) trace_point(stage, event)
+#  define KBRDHOOK_TRACE_END(stage, event) trace_end(stage, event)
+#  define KBRDHOOK_TRACE_DUMP(file) trace_dump(file)
+
+#else
+
+#  define KBRDHOOK_TRACE_BEGIN(event)
+#  define KBRDHOOK_TRACE(stage, event)
+#  define KBRDHOOK_TRACE_END(stage, event)
+#  define KBRDHOOK_TRACE_DUMP(file)
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "com_thread.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+// a drain on the com thread that has run longer than the deadline. while
+// it runs, input is not processed and the OS may time out the keyboard
+// hook.
+struct com_thread_stall {
+  // how long the drain had been running when the watchdog looked
+  com_thread::duration_t elapsed_;
+  // tasks the drain had finished
+  std::uint64_t tasksRun_;
+  // the label of the task that was running, "unlabelled" when it had none
+  const char* label_;
+};
+
+inline void print_stall(void*, const com_thread_stall& stall) noexcept {
+  fprintf(
+      stderr,
+      "com thread stalled: drain running for %.1fms after %llu tasks, in %s\n",
+      std::chrono::duration<double, std::milli>(stall.elapsed_).count(),
+      static_cast<unsigned long long>(stall.tasksRun_),
+      stall.label_);
+  fflush(stderr);
+}
+
+// watches the heartbeat of a com_thread from a thread of its own, and
+// reports each drain that runs past the deadline once. the com thread only
+// writes its heartbeat, it never waits for the watchdog.
+class com_thread_watchdog {
+public:
+  using clock_t = com_thread::clock_t;
+  using duration_t = com_thread::duration_t;
+  using report_function_t = void (*)(void*, const com_thread_stall&) noexcept;
+
+private:
+  com_thread& com_;
+  duration_t deadline_;
+  report_function_t report_;
+  void* context_;
+  std::atomic<std::uint64_t> stalls_{0};
+  std::mutex lock_;
+  std::condition_variable wake_;
+  bool stop_{false};
+  std::thread thread_;
+
+  void run() noexcept {
+    // drains are told apart by their start time
+    duration_t::rep reported = 0;
+    std::unique_lock guard{lock_};
+    // look a few times per deadline so that a stall is reported soon after
+    // it passes the deadline
+    while (!wake_.wait_for(guard, deadline_ / 4, [this] { return stop_; })) {
+      auto start = com_.heartbeat_.drainStart_.load(std::memory_order_acquire);
+      if (start == 0 || start == reported) {
+        continue;
+      }
+      auto elapsed = clock_t::now().time_since_epoch() - duration_t{start};
+      if (elapsed < deadline_) {
+        continue;
+      }
+      const char* label =
+          com_.heartbeat_.label_.load(std::memory_order_relaxed);
+      com_thread_stall stall{
+          elapsed,
+          com_.heartbeat_.tasksRun_.load(std::memory_order_relaxed),
+          !!label ? label : "unlabelled"};
+      // the drain may have ended while the fields were read
+      if (com_.heartbeat_.drainStart_.load(std::memory_order_acquire) !=
+          start) {
+        continue;
+      }
+      reported = start;
+      stalls_.fetch_add(1, std::memory_order_relaxed);
+      report_(context_, stall);
+    }
+  }
+
+public:
+  explicit com_thread_watchdog(
+      com_thread& com,
+      duration_t deadline,
+      report_function_t report = &print_stall,
+      void* context = nullptr)
+    : com_(com)
+    , deadline_(deadline)
+    , report_(report)
+    , context_(context)
+    , thread_([this]() noexcept { run(); }) {}
+  com_thread_watchdog(com_thread_watchdog&&) = delete;
+  ~com_thread_watchdog() {
+    {
+      std::lock_guard guard{lock_};
+      stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+  }
+
+  // drains that have been reported
+  std::uint64_t stalls() const noexcept {
+    return stalls_.load(std::memory_order_relaxed);
+  }
+};
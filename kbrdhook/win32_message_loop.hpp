@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <exception>
+
+#include <windows.h>
+#include <windowsx.h>
+#include <winuser.h>
+
+// com_thread event source for windows - the thread message queue of an
+// apartment threaded COM thread
+class win32_message_loop {
+  // the com thread, set by attach() before any other thread posts to it
+  DWORD threadId_ = 0;
+  // time between the last message being posted and GetMessage returning it
+  std::chrono::milliseconds latency_{0};
+  // time spent in TranslateMessage and DispatchMessage by the last wait()
+  std::chrono::steady_clock::duration dispatch_{0};
+
+public:
+  // called on the com thread before the loop starts
+  void attach() noexcept {
+    threadId_ = GetCurrentThreadId();
+    {  // create message queue
+      MSG msg;
+      PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+    }
+
+    if (FAILED(CoInitializeEx(
+            nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE))) {
+      std::terminate();
+    }
+  }
+
+  // called on the com thread after the loop exits
+  void detach() noexcept { CoUninitialize(); }
+
+  // block until a message arrives and dispatch it. returns false when the
+  // loop has been asked to quit.
+  bool wait() noexcept {
+    MSG msg = {};
+    BOOL pendingMessages = GetMessage(&msg, NULL, 0, 0);
+    if (pendingMessages == -1) {
+      std::terminate();
+    }
+    if (pendingMessages == 0) {
+      return false;
+    }
+    latency_ = std::chrono::milliseconds(
+        static_cast<DWORD>(GetTickCount()) -
+        static_cast<DWORD>(GetMessageTime()));
+    auto start = std::chrono::steady_clock::now();
+    TranslateMessage(&msg);
+    DispatchMessage(&msg);
+    dispatch_ = std::chrono::steady_clock::now() - start;
+    return true;
+  }
+
+  // how long the message returned by the last wait() was queued
+  std::chrono::steady_clock::duration message_latency() const noexcept {
+    return latency_;
+  }
+
+  // how long the last wait() spent dispatching its message
+  std::chrono::steady_clock::duration dispatch_time() const noexcept {
+    return dispatch_;
+  }
+
+  // wake the loop from any thread. fails until the com thread has created
+  // its message queue.
+  bool wake() noexcept {
+    return !!PostThreadMessageW(threadId_, WM_USER, 0, 0L);
+  }
+
+  // the time slice ended with work still queued. post a WM_USER behind the
+  // messages already queued so that they are dispatched first. (if the
+  // post fails the queue is full and the loop will be back anyway)
+  void resume() noexcept { (void)wake(); }
+
+  bool quit() noexcept {
+    return !!PostThreadMessageW(threadId_, WM_QUIT, 0, 0L);
+  }
+};
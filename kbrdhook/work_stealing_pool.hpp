@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <unifex/create.hpp>
+#include <unifex/receiver_concepts.hpp>
+#include <unifex/scheduler_concepts.hpp>
+#include <unifex/sender_concepts.hpp>
+#include <unifex/stop_token_concepts.hpp>
+#include <unifex/typed_via.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// a thread pool for work that has no thread affinity (decoding, mixing,
+// analytics). each worker has its own deque - the worker pushes and pops
+// at the back, idle workers steal from the front of a randomly chosen
+// victim.
+class work_stealing_pool {
+public:
+  // an operation scheduled onto the pool
+  struct task {
+    void (*execute_)(task*) noexcept;
+    task* next_{nullptr};
+    task* prev_{nullptr};
+  };
+
+private:
+  struct alignas(64) worker {
+    std::mutex lock_;
+    // oldest task, stolen by other workers
+    task* head_{nullptr};
+    // newest task, run next by the owner
+    task* tail_{nullptr};
+
+    void push(task* t) noexcept {
+      std::lock_guard guard{lock_};
+      t->next_ = nullptr;
+      t->prev_ = tail_;
+      if (!!tail_) {
+        tail_->next_ = t;
+      } else {
+        head_ = t;
+      }
+      tail_ = t;
+    }
+
+    task* pop() noexcept {
+      std::lock_guard guard{lock_};
+      auto* t = tail_;
+      if (!!t) {
+        tail_ = t->prev_;
+        if (!!tail_) {
+          tail_->next_ = nullptr;
+        } else {
+          head_ = nullptr;
+        }
+      }
+      return t;
+    }
+
+    task* steal() noexcept {
+      std::lock_guard guard{lock_};
+      auto* t = head_;
+      if (!!t) {
+        head_ = t->next_;
+        if (!!head_) {
+          head_->prev_ = nullptr;
+        } else {
+          tail_ = nullptr;
+        }
+      }
+      return t;
+    }
+  };
+
+  std::size_t size_;
+  std::unique_ptr<worker[]> workers_;
+  // bumped on every submit so that a worker going to sleep notices work
+  // that arrived after it last looked
+  std::atomic<std::uint32_t> epoch_{0};
+  std::atomic<std::uint32_t> sleeping_{0};
+  std::atomic<bool> stop_{false};
+  // round robin for submissions from threads outside the pool
+  std::atomic<std::size_t> nextWorker_{0};
+  std::vector<std::thread> threads_;
+
+  // the pool and worker index of the current thread
+  static inline thread_local work_stealing_pool* currentPool_ = nullptr;
+  static inline thread_local std::size_t currentWorker_ = 0;
+
+  task* find_work(std::size_t self, std::minstd_rand& random) noexcept {
+    if (auto* t = workers_[self].pop()) {
+      return t;
+    }
+    auto start = static_cast<std::size_t>(random()) % size_;
+    for (std::size_t i = 0; i < size_; ++i) {
+      auto victim = (start + i) % size_;
+      if (victim == self) {
+        continue;
+      }
+      if (auto* t = workers_[victim].steal()) {
+        return t;
+      }
+    }
+    return nullptr;
+  }
+
+  void run(std::size_t self) noexcept {
+    currentPool_ = this;
+    currentWorker_ = self;
+    std::minstd_rand random{static_cast<std::uint_fast32_t>(self + 1)};
+    for (;;) {
+      if (auto* t = find_work(self, random)) {
+        t->execute_(t);
+        continue;
+      }
+      auto epoch = epoch_.load(std::memory_order_seq_cst);
+      // look again now that the epoch is captured, so a submit between the
+      // first look and the wait is not missed
+      if (auto* t = find_work(self, random)) {
+        t->execute_(t);
+        continue;
+      }
+      if (stop_.load(std::memory_order_acquire)) {
+        return;
+      }
+      sleeping_.fetch_add(1, std::memory_order_seq_cst);
+      epoch_.wait(epoch, std::memory_order_seq_cst);
+      sleeping_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+public:
+  explicit work_stealing_pool(
+      std::size_t size = std::max(1u, std::thread::hardware_concurrency()))
+    : size_(size)
+    , workers_(new worker[size]) {
+    if (size_ == 0) {
+      // a pool without workers would never run anything
+      std::terminate();
+    }
+    threads_.reserve(size_);
+    for (std::size_t i = 0; i < size_; ++i) {
+      threads_.emplace_back([this, i]() noexcept { run(i); });
+    }
+  }
+  work_stealing_pool(work_stealing_pool&&) = delete;
+  // runs the queued work and then joins the workers
+  ~work_stealing_pool() {
+    stop_.store(true, std::memory_order_release);
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    epoch_.notify_all();
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  std::size_t size() const noexcept { return size_; }
+
+  // work scheduled from a worker stays on that worker's deque until another
+  // worker steals it
+  void submit(task* t) noexcept {
+    auto target = currentPool_ == this
+        ? currentWorker_
+        : nextWorker_.fetch_add(1, std::memory_order_relaxed) % size_;
+    workers_[target].push(t);
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_seq_cst) > 0) {
+      epoch_.notify_one();
+    }
+  }
+
+  struct make_sender {
+    work_stealing_pool* pool_;
+    template <
+        template <typename...>
+        class Variant,
+        template <typename...>
+        class Tuple>
+    using value_types = Variant<Tuple<>>;
+    template <template <typename...> class Variant>
+    using error_types = Variant<>;
+    static inline constexpr bool sends_done = true;
+
+    template <typename Receiver>
+    auto operator()(Receiver& rec) noexcept {
+      struct state : task {
+        Receiver& rec_;
+
+        static void _execute(task* t) noexcept {
+          auto& self = *static_cast<state*>(t);
+          if constexpr (unifex::is_callable_v<
+                            unifex::tag_t<unifex::get_stop_token>,
+                            Receiver&>) {
+            if (unifex::get_stop_token(self.rec_).stop_requested()) {
+              unifex::set_done(std::move(self.rec_));
+              return;
+            }
+          }
+          unifex::set_value(std::move(self.rec_));
+        }
+
+        state(work_stealing_pool* pool, Receiver& rec)
+          : task{&_execute}
+          , rec_(rec) {
+          pool->submit(this);
+        }
+        state() = delete;
+        state(const state&) = delete;
+        state(state&&) = delete;
+      };
+
+      return state{pool_, rec};
+    }
+  };
+
+  struct _scheduler {
+    work_stealing_pool* pool_;
+    _scheduler() = delete;
+    explicit _scheduler(work_stealing_pool* pool) : pool_(pool) {}
+    _scheduler(const _scheduler&) = default;
+    _scheduler(_scheduler&&) = default;
+
+    auto schedule() { return unifex::create(make_sender{pool_}); }
+
+    friend bool operator==(_scheduler a, _scheduler b) noexcept {
+      return a.pool_ == b.pool_;
+    }
+    friend bool operator!=(_scheduler a, _scheduler b) noexcept {
+      return a.pool_ != b.pool_;
+    }
+  };
+  _scheduler get_scheduler() { return _scheduler{this}; }
+};
+
+// run the sender wherever it runs (typically on the pool) and deliver its
+// result on the affine thread (typically com_thread::get_scheduler()), for
+// the steps that need COM or the message queue
+template <typename Sender, typename AffineScheduler>
+auto schedule_on_affine(Sender&& sender, AffineScheduler affine) {
+  return unifex::typed_via((Sender &&) sender, std::move(affine));
+}
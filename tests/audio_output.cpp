@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "audio_output.hpp"
+#include "audio_ring.hpp"
+#include "audio_sink.hpp"
+#include "check.hpp"
+
+namespace {
+using namespace std::literals::chrono_literals;
+
+// renders a ramp, so the order of the frames can be checked
+struct ramp_source {
+  std::atomic<std::size_t> rendered_{0};
+
+  void render(std::span<float> block) noexcept {
+    for (auto& frame : block) {
+      frame = float(rendered_.fetch_add(1, std::memory_order_relaxed));
+    }
+  }
+};
+
+// what counting_sink saw, read once the audio_output is gone
+struct sink_record {
+  std::atomic<std::size_t> blocks_{0};
+  std::atomic<bool> outOfOrder_{false};
+};
+
+// a null_sink that counts the blocks it was given and checks that the
+// ramp arrives in order (or as silence from an underrun)
+struct counting_sink {
+  null_sink pace_;
+  sink_record& record_;
+  float next_{0.0f};
+
+  counting_sink(std::uint32_t sampleRate, sink_record& record)
+    : pace_(sampleRate)
+    , record_(record) {}
+
+  void write(std::span<const float> block) {
+    for (auto frame : block) {
+      if (frame == next_) {
+        next_ += 1.0f;
+      } else if (frame != 0.0f) {
+        record_.outOfOrder_.store(true, std::memory_order_relaxed);
+      }
+    }
+    record_.blocks_.fetch_add(1, std::memory_order_relaxed);
+    pace_.write(block);
+  }
+};
+
+std::vector<float> iota(float first, std::size_t count) {
+  std::vector<float> frames(count);
+  for (auto& frame : frames) {
+    frame = first;
+    first += 1.0f;
+  }
+  return frames;
+}
+
+// writes and reads that wrap around the end of the ring, and a write to a
+// full ring that only takes what fits
+void ring_wraps_around() {
+  audio_ring<8> ring;
+  std::array<float, 8> out{};
+  float next = 0.0f;
+  float expected = 0.0f;
+  for (int i = 0; i < 10; ++i) {
+    auto in = iota(next, 5);
+    CHECK(ring.write(in) == 5);
+    next += 5.0f;
+    CHECK(ring.size() == 5);
+    CHECK(ring.read(std::span<float>{out.data(), 5}) == 5);
+    for (std::size_t f = 0; f < 5; ++f) {
+      CHECK(out[f] == expected);
+      expected += 1.0f;
+    }
+    CHECK(ring.size() == 0);
+  }
+
+  auto in = iota(0.0f, 12);
+  CHECK(ring.write(in) == 8);
+  CHECK(ring.write(in) == 0);
+  CHECK(ring.read(out) == 8);
+  CHECK(out[7] == 7.0f);
+  CHECK(ring.read(out) == 0);
+}
+
+// an ahead distance that is not a whole number of blocks still lets the
+// device start, and the device receives the mixer's frames in order
+void ahead_frames_not_a_whole_block() {
+  for (std::size_t ahead : {1, 255, 256, 300, 513}) {
+    ramp_source source;
+    sink_record record;
+    {
+      audio_output<ramp_source, counting_sink> output{
+          source, ahead, 48000, record};
+      CHECK(output.ahead_frames() % output.blockFrames == 0);
+      CHECK(output.ahead_frames() >= ahead);
+      auto deadline = std::chrono::steady_clock::now() + 2s;
+      while (record.blocks_.load() < 10 &&
+             std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+      }
+      CHECK(output.fill_level() <= output.ahead_frames());
+    }
+    CHECK(record.blocks_.load() >= 10);
+    CHECK(!record.outOfOrder_.load());
+  }
+}
+}  // namespace
+
+int main() {
+  ring_wraps_around();
+  ahead_frames_not_a_whole_block();
+  return check_failures != 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unifex/done_as_optional.hpp>
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/task.hpp>
+#include <unifex/timed_single_thread_context.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "check.hpp"
+#include "manual_event_source.hpp"
+#include "sender_range.hpp"
+
+namespace {
+using namespace std::literals::chrono_literals;
+
+
+template <std::size_t Capacity>
+auto make_range(
+    unifex::inplace_stop_source& stop,
+    manual_event_source<std::uint32_t>& source,
+    overflow_policy policy) {
+  return create_broadcast_event_sender_range<std::uint32_t, Capacity, 4>(
+      stop.get_token(), policy, source.register_fn(), source.unregister_fn());
+}
+
+// counts the events received and checks that they are 1, 2, 3... OnEvent is
+// called with the number of events received so far.
+template <typename View, typename OnEvent>
+unifex::task<void> consume(
+    View view,
+    std::uint32_t count,
+    std::atomic<std::uint32_t>& received,
+    OnEvent onEvent) {
+  for (auto next : view) {
+    auto event = co_await unifex::done_as_optional(std::move(next));
+    if (!event) {
+      break;
+    }
+    CHECK(*event == received + 1);
+    onEvent(++received);
+    if (received == count) {
+      break;
+    }
+  }
+  co_return;
+}
+
+// every subscriber sees every event, in order
+void every_subscriber_sees_every_event() {
+  constexpr std::uint32_t count = 1000;
+  manual_event_source<std::uint32_t> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range<16>(stop, source, overflow_policy::block);
+
+  unifex::timed_single_thread_context contexts[3];
+  std::atomic<std::uint32_t> received[3] = {0, 0, 0};
+  auto a = range.subscribe(contexts[0].get_scheduler());
+  auto b = range.subscribe(contexts[1].get_scheduler());
+  auto c = range.subscribe(contexts[2].get_scheduler());
+  CHECK(!!a && !!b && !!c);
+  if (!a || !b || !c) {
+    return;
+  }
+  auto ignore = [](std::uint32_t) {};
+  std::thread consumers[] = {
+      std::thread{[&]() {
+        unifex::sync_wait(consume(a->view(), count, received[0], ignore));
+      }},
+      std::thread{[&]() {
+        unifex::sync_wait(consume(b->view(), count, received[1], ignore));
+      }},
+      std::thread{[&]() {
+        unifex::sync_wait(consume(c->view(), count, received[2], ignore));
+      }}};
+
+  for (std::uint32_t vk = 1; vk <= count; ++vk) {
+    source.emit(vk);
+  }
+  for (auto& consumer : consumers) {
+    consumer.join();
+  }
+  for (auto& r : received) {
+    CHECK(r == count);
+  }
+  CHECK(range.dropped_events() == 0);
+}
+
+// the first subscriber does not finish its first event until the second
+// subscriber has seen every event. that only works when neither of them
+// runs on the producer thread.
+void subscribers_are_not_serialized() {
+  constexpr std::uint32_t count = 32;
+  manual_event_source<std::uint32_t> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range<64>(stop, source, overflow_policy::block);
+
+  unifex::timed_single_thread_context contexts[2];
+  std::atomic<std::uint32_t> slowReceived{0};
+  std::atomic<std::uint32_t> fastReceived{0};
+  auto slow = range.subscribe(contexts[0].get_scheduler());
+  auto fast = range.subscribe(contexts[1].get_scheduler());
+  CHECK(!!slow && !!fast);
+  if (!slow || !fast) {
+    return;
+  }
+  auto waitForFast = [&](std::uint32_t received) {
+    if (received != 1) {
+      return;
+    }
+    auto deadline = std::chrono::steady_clock::now() + 2s;
+    while (fastReceived != count &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+    }
+    CHECK(fastReceived == count);
+  };
+  std::thread consumers[] = {
+      std::thread{[&]() {
+        unifex::sync_wait(
+            consume(slow->view(), count, slowReceived, waitForFast));
+      }},
+      std::thread{[&]() {
+        unifex::sync_wait(
+            consume(fast->view(), count, fastReceived, [](std::uint32_t) {}));
+      }}};
+
+  // let both subscribers start waiting, so that the producer completes
+  // their senders
+  std::this_thread::sleep_for(20ms);
+  for (std::uint32_t vk = 1; vk <= count; ++vk) {
+    source.emit(vk);
+  }
+  for (auto& consumer : consumers) {
+    consumer.join();
+  }
+  CHECK(slowReceived == count);
+}
+
+// subscriptions come and go while another thread publishes. each one sees
+// consecutive events starting from the first one published after it
+// subscribed.
+void subscribe_while_publishing() {
+  manual_event_source<std::uint32_t> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range<8>(stop, source, overflow_policy::block);
+  unifex::timed_single_thread_context context;
+
+  std::atomic<bool> done{false};
+  std::thread producer{[&]() {
+    for (std::uint32_t vk = 1; !done; ++vk) {
+      source.emit(vk);
+    }
+  }};
+
+  for (int i = 0; i < 200; ++i) {
+    auto subscription = range.subscribe(context.get_scheduler());
+    CHECK(!!subscription);
+    if (!subscription) {
+      break;
+    }
+    auto view = subscription->view();
+    std::uint32_t last = 0;
+    for (int e = 0; e < 5; ++e) {
+      auto event = unifex::sync_wait(*view.begin());
+      CHECK(!!event);
+      if (!!event) {
+        CHECK(last == 0 || *event == last + 1);
+        last = *event;
+      }
+    }
+  }
+
+  done = true;
+  producer.join();
+  CHECK(range.dropped_events() == 0);
+}
+
+// a producer blocked by a subscriber that never takes an event is released
+// when the range stops
+void block_after_subscriber_gone() {
+  manual_event_source<std::uint32_t> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range<4>(stop, source, overflow_policy::block);
+  unifex::timed_single_thread_context context;
+  auto subscription = range.subscribe(context.get_scheduler());
+
+  std::thread producer{[&]() {
+    for (std::uint32_t vk = 1; vk <= 10; ++vk) {
+      source.emit(vk);
+    }
+  }};
+  std::this_thread::sleep_for(20ms);
+  CHECK(range.queued_events() == 4);
+  stop.request_stop();
+  producer.join();
+  CHECK(range.dropped_events() == 6);
+}
+
+// subscribing with every slot in use fails without touching the other
+// subscriptions, and a released slot can be taken again
+void subscribe_when_full() {
+  manual_event_source<std::uint32_t> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range<4>(stop, source, overflow_policy::drop_newest);
+  unifex::timed_single_thread_context context;
+  auto a = range.subscribe(context.get_scheduler());
+  auto b = range.subscribe(context.get_scheduler());
+  auto c = range.subscribe(context.get_scheduler());
+  {
+    auto d = range.subscribe(context.get_scheduler());
+    CHECK(!!a && !!b && !!c && !!d);
+    CHECK(!range.subscribe(context.get_scheduler()));
+  }
+  auto e = range.subscribe(context.get_scheduler());
+  CHECK(!!e);
+  if (!e) {
+    return;
+  }
+  source.emit(1);
+  auto view = e->view();
+  auto event = unifex::sync_wait(*view.begin());
+  CHECK(!!event && *event == 1);
+}
+}  // namespace
+
+int main() {
+  every_subscriber_sees_every_event();
+  subscribers_are_not_serialized();
+  subscribe_while_publishing();
+  block_after_subscriber_gone();
+  subscribe_when_full();
+  return check_failures != 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdio>
+
+// the number of failed checks in this test
+inline int check_failures = 0;
+
+// report a failed expectation and keep going, so one run shows every
+// failure. main() returns check_failures != 0.
+#define CHECK(...)                                                      \
+  do {                                                                  \
+    if (!(__VA_ARGS__)) {                                               \
+      ++check_failures;                                                 \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+              #__VA_ARGS__);                                            \
+    }                                                                   \
+  } while (false)
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unifex/sync_wait.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <thread>
+
+#include "check.hpp"
+#include "event_log.hpp"
+#include "key_event.hpp"
+
+namespace {
+using namespace std::literals::chrono_literals;
+
+// records written are read back, past the capacity they are dropped
+void write_and_read(const std::filesystem::path& path) {
+  {
+    event_log_writer<key_event> log{path, 20};
+    for (std::uint32_t i = 0; i < 25; ++i) {
+      log.append(key_event{0x0100, 0x41 + i});
+    }
+    CHECK(log.written() == 20);
+    CHECK(log.dropped() == 5);
+  }
+  // trimmed on close
+  CHECK(
+      std::filesystem::file_size(path) ==
+      sizeof(detail::event_log_header) +
+          20 * sizeof(event_log_record<key_event>));
+  event_log_reader<key_event> reader{path};
+  auto records = reader.records();
+  CHECK(records.size() == 20);
+  for (std::uint32_t i = 0; i < records.size(); ++i) {
+    CHECK(records[i].event_.vkCode_ == 0x41 + i);
+    CHECK(i == 0 || records[i].time_ >= records[i - 1].time_);
+  }
+}
+
+// the record count is current while the log is still open, so a writer
+// that never closes (a crash) leaves a readable log
+void read_while_writing(const std::filesystem::path& path) {
+  event_log_writer<key_event> log{path, 1000};
+  for (std::uint32_t i = 0; i < 10; ++i) {
+    log.append(key_event{0x0100, 0x41 + i});
+  }
+  event_log_reader<key_event> reader{path};
+  CHECK(reader.records().size() == 10);
+  if (reader.records().size() == 10) {
+    CHECK(reader.records().back().event_.vkCode_ == 0x41 + 9);
+  }
+}
+
+// a log that cannot be created is not valid and drops every event
+void unwritable_path(const std::filesystem::path& directory) {
+  event_log_writer<key_event> log{
+      directory / "kbrdhook_no_such_dir" / "log.kbel", 10};
+  CHECK(!log.valid());
+  log.append(key_event{0x0100, 0x41});
+  CHECK(log.written() == 0);
+  CHECK(log.dropped() == 1);
+}
+
+void write_log(const std::filesystem::path& path, std::uint32_t events) {
+  event_log_writer<key_event> log{path, events};
+  for (std::uint32_t i = 0; i < events; ++i) {
+    log.append(key_event{0x0100, 0x41 + i % 26});
+  }
+}
+
+// the consumer is gone while the replay thread is blocked on a full buffer.
+// destroy() must still return.
+void destroy_without_consumer(const std::filesystem::path& path) {
+  write_log(path, 100);
+  replay_event_source<key_event, 4> replay{
+      path, replay_timing::as_fast_as_possible, overflow_policy::block};
+  unifex::sync_wait(replay.start());
+  std::this_thread::sleep_for(20ms);
+  CHECK(replay.queued_events() == 4);
+
+  std::atomic<bool> destroyed{false};
+  std::thread destroyer{[&]() {
+    unifex::sync_wait(replay.destroy());
+    destroyed = true;
+  }};
+  auto deadline = std::chrono::steady_clock::now() + 2s;
+  while (!destroyed && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  if (!destroyed) {
+    fprintf(stderr, "replay_event_source::destroy() did not return\n");
+    std::_Exit(1);
+  }
+  destroyer.join();
+  CHECK(replay.queued_events() == 4);
+  // at least the event that was blocked was discarded
+  CHECK(replay.dropped_events() >= 1);
+}
+}  // namespace
+
+int main() {
+  auto path = std::filesystem::temp_directory_path() / "kbrdhook_test.kbel";
+  write_and_read(path);
+  read_while_writing(path);
+  unwritable_path(path.parent_path());
+  destroy_without_consumer(path);
+  std::filesystem::remove(path);
+  return check_failures != 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "event_ring.hpp"
+
+namespace {
+using namespace std::literals::chrono_literals;
+
+using ring = event_ring<int, 4>;
+
+std::vector<int> drain(ring& r) {
+  std::vector<int> events;
+  while (auto event = r.try_pop()) {
+    events.push_back(event.value());
+  }
+  return events;
+}
+
+void drop_newest() {
+  ring r{overflow_policy::drop_newest};
+  for (int i = 0; i < 6; ++i) {
+    CHECK(r.push(i) == (i < 4));
+  }
+  CHECK(r.queued_count() == 4);
+  CHECK(r.dropped_count() == 2);
+  CHECK(drain(r) == std::vector<int>{0, 1, 2, 3});
+}
+
+void drop_oldest() {
+  ring r{overflow_policy::drop_oldest};
+  for (int i = 0; i < 6; ++i) {
+    CHECK(r.push(i));
+  }
+  CHECK(r.queued_count() == 6);
+  CHECK(r.dropped_count() == 2);
+  CHECK(drain(r) == std::vector<int>{2, 3, 4, 5});
+}
+
+void block_until_popped() {
+  ring r{overflow_policy::block};
+  for (int i = 0; i < 4; ++i) {
+    CHECK(r.push(i));
+  }
+  std::atomic<bool> pushed{false};
+  std::thread producer{[&]() {
+    CHECK(r.push(4));
+    pushed = true;
+  }};
+  std::this_thread::sleep_for(20ms);
+  CHECK(!pushed);
+  CHECK(r.try_pop() == 0);
+  producer.join();
+  CHECK(pushed);
+  CHECK(r.dropped_count() == 0);
+  CHECK(drain(r) == std::vector<int>{1, 2, 3, 4});
+}
+
+// the consumer has gone and will never pop. close() must release the
+// producer instead of leaving it spinning forever.
+void block_released_by_close() {
+  ring r{overflow_policy::block};
+  for (int i = 0; i < 4; ++i) {
+    CHECK(r.push(i));
+  }
+  std::atomic<bool> result{true};
+  std::thread producer{[&]() { result = r.push(4); }};
+  std::this_thread::sleep_for(20ms);
+  r.close();
+  producer.join();
+  CHECK(!result);
+  CHECK(r.dropped_count() == 1);
+  // a closed ring that is full does not block
+  CHECK(!r.push(5));
+  CHECK(r.dropped_count() == 2);
+  CHECK(drain(r) == std::vector<int>{0, 1, 2, 3});
+}
+
+// events are only discarded while the ring is full
+void wraps_around() {
+  ring r{overflow_policy::drop_newest};
+  int expected = 0;
+  for (int i = 0; i < 100; ++i) {
+    CHECK(r.push(i));
+    if (i % 3 == 2) {
+      for (auto event : drain(r)) {
+        CHECK(event == expected++);
+      }
+    }
+  }
+  for (auto event : drain(r)) {
+    CHECK(event == expected++);
+  }
+  CHECK(expected == 100);
+  CHECK(r.dropped_count() == 0);
+}
+}  // namespace
+
+int main() {
+  drop_newest();
+  drop_oldest();
+  block_until_popped();
+  block_released_by_close();
+  wraps_around();
+  return check_failures != 0;
+}
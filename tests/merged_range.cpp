@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/stop_when.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/timed_single_thread_context.hpp>
+
+#include <array>
+#include <cstddef>
+#include <thread>
+#include <variant>
+
+#include "check.hpp"
+#include "manual_event_source.hpp"
+#include "merged_range.hpp"
+#include "sender_range.hpp"
+
+namespace {
+constexpr std::size_t events = 20000;
+constexpr std::size_t sources = 3;
+
+// three producer threads flood their own sender_range, and the consumer
+// takes each event from merge() with take(merged). every event must
+// arrive, in order within its source.
+template <typename Take>
+void flood(Take take) {
+  std::array<manual_event_source<std::size_t>, sources> source;
+  unifex::inplace_stop_source stop;
+  auto make = [&](std::size_t i) {
+    return create_buffered_event_sender_range<std::size_t, 1024>(
+        stop.get_token(),
+        overflow_policy::block,
+        source[i].register_fn(),
+        source[i].unregister_fn());
+  };
+  auto range0 = make(0);
+  auto range1 = make(1);
+  auto range2 = make(2);
+  auto merged = merge(range0.view(), range1.view(), range2.view());
+
+  std::array<std::thread, sources> producers;
+  for (std::size_t i = 0; i < sources; ++i) {
+    producers[i] = std::thread{[&, i]() {
+      for (std::size_t n = 0; n < events; ++n) {
+        source[i].emit(n);
+      }
+    }};
+  }
+
+  std::array<std::size_t, sources> received{};
+  std::size_t outOfOrder = 0;
+  // block means no event is dropped
+  for (std::size_t total = 0; total < sources * events;) {
+    auto event = take(merged);
+    if (!event) {
+      continue;
+    }
+    auto from = event->index();
+    auto n = std::visit([](std::size_t n) { return n; }, *event);
+    if (n != received[from]++) {
+      ++outOfOrder;
+    }
+    ++total;
+  }
+  for (auto& p : producers) {
+    p.join();
+  }
+  stop.request_stop();
+
+  CHECK(received[0] == events);
+  CHECK(received[1] == events);
+  CHECK(received[2] == events);
+  CHECK(outOfOrder == 0);
+}
+
+void ordered() {
+  flood([](auto& merged) { return unifex::sync_wait(*merged.begin()); });
+}
+
+// every merged sender is cancelled from the timer thread while it starts,
+// waits or takes a slot, and the producers complete slots from their own
+// threads. a cancelled sender leaves its event for the next one.
+void cancel_while_completing() {
+  unifex::timed_single_thread_context timer;
+  auto scheduler = timer.get_scheduler();
+  flood([&](auto& merged) {
+    return unifex::sync_wait(
+        unifex::stop_when(*merged.begin(), unifex::schedule(scheduler)));
+  });
+}
+}  // namespace
+
+int main() {
+  ordered();
+  cancel_while_completing();
+  return check_failures != 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "check.hpp"
+#include "pcm_kernels.hpp"
+
+namespace {
+constexpr std::size_t maxVoices = 64;
+constexpr std::size_t maxFrames = 263;
+
+struct voices {
+  std::vector<std::vector<float>> float_;
+  std::vector<std::vector<std::int16_t>> int_;
+
+  voices() : float_(maxVoices), int_(maxVoices) {
+    std::uint32_t noise = 1;
+    for (std::size_t v = 0; v < maxVoices; ++v) {
+      for (std::size_t i = 0; i < maxFrames; ++i) {
+        noise = noise * 1664525u + 1013904223u;
+        auto sample = float(noise >> 8) / float(1u << 24) * 2.0f - 1.0f;
+        float_[v].push_back(sample);
+        int_[v].push_back(std::int16_t(sample * 32767.0f));
+      }
+    }
+  }
+};
+
+// mix, gain, clip and convert, as the mixer and sink do. 64 voices at
+// 0.25 exceed full scale, so the clipping paths run too.
+void render_float(
+    const pcm_kernels& k,
+    const voices& in,
+    std::size_t voiceCount,
+    std::size_t frames,
+    std::vector<float>& out,
+    std::vector<std::int16_t>& converted) {
+  out.assign(frames, 0.0f);
+  converted.assign(frames, 0);
+  for (std::size_t v = 0; v < voiceCount; ++v) {
+    k.mix_f32(out.data(), in.float_[v].data(), 0.25f, frames);
+  }
+  k.gain_f32(out.data(), 1.5f, frames);
+  k.clip_f32(out.data(), frames);
+  k.saturate_f32_to_i16(out.data(), converted.data(), frames);
+}
+
+void render_int(
+    const pcm_kernels& k,
+    const voices& in,
+    std::size_t voiceCount,
+    std::size_t frames,
+    std::vector<std::int16_t>& out) {
+  out.assign(frames, 0);
+  for (std::size_t v = 0; v < voiceCount; ++v) {
+    k.mix_i16(out.data(), in.int_[v].data(), 8192, frames);
+  }
+  k.gain_i16(out.data(), 16384, frames);
+}
+
+// the kernels for level must match the scalar path. the frame counts that
+// are not a multiple of the vector width run the scalar tail loops.
+void matches_scalar(simd_level level, const voices& in) {
+  const auto& scalar = get_pcm_kernels(simd_level::scalar);
+  const auto& kernels = get_pcm_kernels(level);
+  for (std::size_t frames : {0, 1, 7, 15, 256, 257, 263}) {
+    for (std::size_t voiceCount : {1, 8, 64}) {
+      std::vector<float> out, expected;
+      std::vector<std::int16_t> converted, expectedConverted;
+      std::vector<std::int16_t> intOut, expectedInt;
+      render_float(scalar, in, voiceCount, frames, expected, expectedConverted);
+      render_float(kernels, in, voiceCount, frames, out, converted);
+      render_int(scalar, in, voiceCount, frames, expectedInt);
+      render_int(kernels, in, voiceCount, frames, intOut);
+      std::size_t mismatch = 0;
+      while (mismatch < frames &&
+             std::fabs(out[mismatch] - expected[mismatch]) <= 1e-4f &&
+             std::abs(converted[mismatch] - expectedConverted[mismatch]) <= 1 &&
+             intOut[mismatch] == expectedInt[mismatch]) {
+        ++mismatch;
+      }
+      CHECK(mismatch == frames);
+      if (mismatch != frames) {
+        fprintf(
+            stderr, "%s, %zu frames, %zu voices: mismatch at %zu\n",
+            to_string(level), frames, voiceCount, mismatch);
+      }
+    }
+  }
+}
+}  // namespace
+
+int main() {
+  const voices in;
+  const auto detected = detect_simd_level();
+  printf("detected %s\n", to_string(detected));
+  for (auto level : {simd_level::sse2, simd_level::avx2}) {
+    if (level > detected) {
+      break;
+    }
+    matches_scalar(level, in);
+  }
+  return check_failures != 0;
+}
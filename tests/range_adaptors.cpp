@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unifex/done_as_optional.hpp>
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/stop_when.hpp>
+#include <unifex/sync_wait.hpp>
+#include <unifex/task.hpp>
+#include <unifex/timed_single_thread_context.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "check.hpp"
+#include "key_event.hpp"
+#include "manual_event_source.hpp"
+#include "range_adaptors.hpp"
+
+namespace {
+using namespace std::literals::chrono_literals;
+
+constexpr std::size_t bursts = 10;
+constexpr std::size_t perBurst = 20;
+
+auto make_range(
+    unifex::inplace_stop_source& stop,
+    manual_event_source<key_event>& source) {
+  return create_buffered_event_sender_range<key_event, 1024>(
+      stop.get_token(),
+      overflow_policy::block,
+      source.register_fn(),
+      source.unregister_fn());
+}
+
+// auto-repeat bursts of one key, 100us apart, with 20ms between bursts.
+// each burst is a different key than the one before it.
+void emit_bursts(
+    manual_event_source<key_event>& source,
+    unifex::inplace_stop_source& stop) {
+  for (std::size_t b = 0; b < bursts; ++b) {
+    for (std::size_t i = 0; i < perBurst; ++i) {
+      source.emit(key_event{0x0100, std::uint32_t(0x41 + b % 2)});
+      std::this_thread::sleep_for(100us);
+    }
+    std::this_thread::sleep_for(20ms);
+  }
+  stop.request_stop();
+}
+
+template <typename Range>
+unifex::task<void> consume(Range& range, std::size_t& received) {
+  for (auto next : range) {
+    auto event = co_await unifex::done_as_optional(std::move(next));
+    if (!event) {
+      break;
+    }
+    ++received;
+  }
+  co_return;
+}
+
+// the number of events from emit_bursts() that the adapted range lets
+// through
+template <typename Adapt>
+std::size_t count_through(Adapt adapt) {
+  manual_event_source<key_event> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range(stop, source);
+  auto adapted = adapt(range.view());
+
+  std::thread producer{[&]() { emit_bursts(source, stop); }};
+  std::size_t received = 0;
+  unifex::sync_wait(consume(adapted, received));
+  producer.join();
+  return received;
+}
+
+// a late sleep may split a burst, but never merge two of them
+template <typename Scheduler>
+void bursts_through_adaptors(Scheduler scheduler) {
+  CHECK(
+      count_through([](auto view) {
+        return distinct_until_changed(std::move(view));
+      }) == bursts);
+  CHECK(
+      count_through([&](auto view) {
+        return throttle(std::move(view), scheduler, 5ms);
+      }) >= bursts);
+  CHECK(
+      count_through([&](auto view) {
+        return debounce(std::move(view), scheduler, 5ms);
+      }) >= bursts);
+
+  // every event is either emitted or merged into one that is
+  std::size_t merged = 0;
+  auto coalesced = count_through([&](auto view) {
+    auto count = [&](key_event& held, key_event&& next) {
+      held = next;
+      ++merged;
+    };
+    return coalesce(std::move(view), scheduler, 5ms, count);
+  });
+  CHECK(coalesced >= bursts);
+  CHECK(coalesced + merged == bursts * perBurst);
+}
+
+// adaptors chain through the view() of the adaptor before them
+template <typename Scheduler>
+void chained(Scheduler scheduler) {
+  manual_event_source<key_event> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range(stop, source);
+  auto distinct = distinct_until_changed(range.view());
+  auto throttled = throttle(distinct.view(), scheduler, 5ms);
+
+  std::thread producer{[&]() { emit_bursts(source, stop); }};
+  std::size_t received = 0;
+  unifex::sync_wait(consume(throttled, received));
+  producer.join();
+  // the first event of a burst is more than 5ms after the one before it
+  CHECK(received == bursts);
+}
+
+// the sender is cancelled while an event is held in the window. the next
+// sender must still emit it when the window closes.
+template <typename Scheduler, typename Adapt>
+void cancel_mid_window(Scheduler scheduler, Adapt adapt) {
+  manual_event_source<key_event> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range(stop, source);
+  auto adapted = adapt(range.view());
+  auto after = [&](auto delay) {
+    return unifex::schedule_at(scheduler, unifex::now(scheduler) + delay);
+  };
+
+  source.emit(key_event{0x0100, 0x41});
+  auto cancelled =
+      unifex::sync_wait(unifex::stop_when(*adapted.begin(), after(10ms)));
+  auto held =
+      unifex::sync_wait(unifex::stop_when(*adapted.begin(), after(500ms)));
+  stop.request_stop();
+
+  CHECK(!cancelled);
+  CHECK(!!held && held->vkCode_ == 0x41);
+}
+}  // namespace
+
+int main() {
+  unifex::timed_single_thread_context timer;
+  auto scheduler = timer.get_scheduler();
+
+  bursts_through_adaptors(scheduler);
+  chained(scheduler);
+  cancel_mid_window(scheduler, [&](auto view) {
+    return debounce(std::move(view), scheduler, 50ms);
+  });
+  cancel_mid_window(scheduler, [&](auto view) {
+    return coalesce(std::move(view), scheduler, 50ms);
+  });
+  return check_failures != 0;
+}
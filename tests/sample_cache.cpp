@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include "check.hpp"
+#include "sample_cache.hpp"
+
+namespace {
+namespace fs = std::filesystem;
+
+constexpr std::uint32_t sampleRate = 48000;
+
+// a PCM wav file with interleaved samples of bits / 8 bytes each
+void write_wav(
+    const fs::path& path,
+    std::uint32_t rate,
+    std::uint16_t channels,
+    std::uint16_t bits,
+    const std::vector<std::int32_t>& samples) {
+  std::vector<std::uint8_t> bytes;
+  auto put = [&](std::uint32_t v, int size) {
+    for (int i = 0; i < size; ++i) {
+      bytes.push_back(std::uint8_t(v >> (8 * i)));
+    }
+  };
+  auto tag = [&](const char* t) { bytes.insert(bytes.end(), t, t + 4); };
+  const std::uint32_t dataBytes = std::uint32_t(samples.size() * bits / 8);
+  tag("RIFF");
+  put(36 + dataBytes, 4);
+  tag("WAVE");
+  tag("fmt ");
+  put(16, 4);
+  put(1, 2);
+  put(channels, 2);
+  put(rate, 4);
+  put(rate * channels * bits / 8, 4);
+  put(channels * bits / 8, 2);
+  put(bits, 2);
+  tag("data");
+  put(dataBytes, 4);
+  for (auto sample : samples) {
+    put(std::uint32_t(sample), bits / 8);
+  }
+  FILE* file = fopen(path.string().c_str(), "wb");
+  CHECK(!!file);
+  if (!!file) {
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+  }
+}
+
+bool near(float a, float b) { return std::fabs(a - b) < 1e-4f; }
+
+// a stereo 16 bit ramp at half the mixer rate
+void write_ramp(const fs::path& path) {
+  std::vector<std::int32_t> samples;
+  for (std::int32_t f = 0; f < 100; ++f) {
+    samples.push_back(f * 100);
+    samples.push_back(f * 100);
+  }
+  write_wav(path, sampleRate / 2, 2, 16, samples);
+}
+
+// every sample decodes to 0.5
+void write_constant(const fs::path& path, std::size_t frames) {
+  write_wav(path, sampleRate, 1, 8, std::vector<std::int32_t>(frames, 192));
+}
+
+bool is_ramp(std::span<const float> samples) {
+  if (samples.size() != 200) {
+    return false;
+  }
+  // every other sample is interpolated
+  for (std::size_t i = 0; i < 198; ++i) {
+    auto expected = float(i) * 50.0f / 32768.0f;
+    if (!near(samples[i], expected)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool is_constant(std::span<const float> samples, std::size_t frames) {
+  if (samples.size() != frames) {
+    return false;
+  }
+  for (auto sample : samples) {
+    if (!near(sample, 0.5f)) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+int main() {
+  auto root = fs::temp_directory_path() / "kbrdhook_test_sample_cache";
+  fs::remove_all(root);
+  fs::create_directories(root / "a");
+  fs::create_directories(root / "b");
+  auto cacheDirectory = root / "cache";
+
+  // the same file name in two directories
+  auto a = root / "a" / "click.wav";
+  auto b = root / "b" / "click.wav";
+  write_ramp(a);
+  write_constant(b, 50);
+
+  {
+    // decoded and resampled on the first run
+    sample_cache cache{cacheDirectory, sampleRate};
+    CHECK(is_ramp(cache.load(a)));
+    CHECK(is_constant(cache.load(b), 50));
+    CHECK(cache.hits() == 0);
+    CHECK(cache.misses() == 2);
+  }
+  {
+    // mapped from the cache on the next run, each from its own file
+    sample_cache cache{cacheDirectory, sampleRate};
+    CHECK(is_ramp(cache.load(a)));
+    CHECK(is_constant(cache.load(b), 50));
+    CHECK(cache.hits() == 2);
+    CHECK(cache.misses() == 0);
+  }
+
+  // a changed source is decoded again
+  write_constant(b, 60);
+  fs::last_write_time(b, fs::last_write_time(b) + std::chrono::seconds(2));
+  {
+    sample_cache cache{cacheDirectory, sampleRate};
+    CHECK(is_constant(cache.load(b), 60));
+    CHECK(is_ramp(cache.load(a)));
+    CHECK(cache.hits() == 1);
+    CHECK(cache.misses() == 1);
+  }
+
+  // a different sample rate does not use the cache files of another
+  {
+    sample_cache cache{cacheDirectory, sampleRate / 2};
+    CHECK(cache.load(a).size() == 100);
+    CHECK(cache.misses() == 1);
+  }
+
+  // missing and unreadable sources
+  {
+    auto text = root / "a" / "notes.wav";
+    FILE* file = fopen(text.string().c_str(), "wb");
+    if (!!file) {
+      fputs("not a wav file", file);
+      fclose(file);
+    }
+    sample_cache cache{cacheDirectory, sampleRate};
+    CHECK(cache.load(root / "a" / "missing.wav").empty());
+#if !defined(_WIN32)
+    CHECK(cache.load(text).empty());
+#endif
+  }
+
+  fs::remove_all(root);
+  return check_failures != 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unifex/inplace_stop_token.hpp>
+#include <unifex/sync_wait.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "manual_event_source.hpp"
+#include "sender_range.hpp"
+
+namespace {
+using namespace std::literals::chrono_literals;
+
+
+template <std::size_t Capacity = 4>
+auto make_range(
+    unifex::inplace_stop_source& stop,
+    manual_event_source<std::uint32_t>& source,
+    overflow_policy policy) {
+  return create_buffered_event_sender_range<std::uint32_t, Capacity>(
+      stop.get_token(), policy, source.register_fn(), source.unregister_fn());
+}
+
+// the next event from the view, 0 when the sender is done
+template <typename View>
+std::uint32_t next_key(View& view) {
+  auto event = unifex::sync_wait(*view.begin());
+  return !!event ? *event : 0;
+}
+
+// six keys arrive before the consumer asks for the first
+void overflow(overflow_policy policy, std::uint32_t first) {
+  manual_event_source<std::uint32_t> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range(stop, source, policy);
+  auto view = range.view();
+  for (std::uint32_t vk = 1; vk <= 6; ++vk) {
+    source.emit(vk);
+  }
+  CHECK(range.dropped_events() == 2);
+  for (std::uint32_t vk = first; vk < first + 4; ++vk) {
+    CHECK(next_key(view) == vk);
+  }
+  // a pending sender takes the next event without dropping anything
+  std::thread producer{[&]() {
+    std::this_thread::sleep_for(10ms);
+    source.emit(7);
+  }};
+  CHECK(next_key(view) == 7);
+  producer.join();
+  CHECK(range.dropped_events() == 2);
+  // every event that was not dropped went through the buffer
+  std::size_t kept = policy == overflow_policy::drop_newest ? 5 : 7;
+  CHECK(range.queued_events() == kept);
+}
+
+// a full buffer blocks the producer until the consumer takes an event
+void block() {
+  manual_event_source<std::uint32_t> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range(stop, source, overflow_policy::block);
+  auto view = range.view();
+  std::thread producer{[&]() {
+    for (std::uint32_t vk = 1; vk <= 8; ++vk) {
+      source.emit(vk);
+    }
+  }};
+  for (std::uint32_t vk = 1; vk <= 8; ++vk) {
+    CHECK(next_key(view) == vk);
+  }
+  producer.join();
+  CHECK(range.dropped_events() == 0);
+  CHECK(range.queued_events() == 8);
+}
+
+// the consumer has gone while the producer is blocked on a full buffer.
+// stopping the range must release the producer, so that an unregister
+// function that joins the producer thread can return.
+void block_after_consumer_gone() {
+  manual_event_source<std::uint32_t> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range(stop, source, overflow_policy::block);
+  std::thread producer{[&]() {
+    for (std::uint32_t vk = 1; vk <= 10; ++vk) {
+      source.emit(vk);
+    }
+  }};
+  std::this_thread::sleep_for(20ms);
+  CHECK(range.queued_events() == 4);
+  stop.request_stop();
+  producer.join();
+  CHECK(range.queued_events() == 4);
+  CHECK(range.dropped_events() == 6);
+  // a sender from a stopped range completes with done
+  auto view = range.view();
+  CHECK(next_key(view) == 0);
+}
+
+// a producer that keeps a drop_oldest buffer full pops events itself, so a
+// pending sender can be out of the queue when the range stops. the stop
+// must still complete it.
+void stop_races_push() {
+  for (int i = 0; i < 200; ++i) {
+    manual_event_source<std::uint32_t> source;
+    unifex::inplace_stop_source stop;
+    auto range = make_range<2>(stop, source, overflow_policy::drop_oldest);
+    std::atomic<bool> done{false};
+    std::thread producer{[&]() {
+      for (std::uint32_t vk = 1; !done; ++vk) {
+        source.emit(vk);
+      }
+    }};
+    std::thread consumer{[&]() {
+      auto view = range.view();
+      while (next_key(view) != 0) {
+      }
+    }};
+    std::this_thread::sleep_for(std::chrono::microseconds(50 * (i % 20)));
+    stop.request_stop();
+    consumer.join();
+    done = true;
+    producer.join();
+  }
+}
+
+// the events of the next batch, empty when the sender is done
+template <typename View>
+std::vector<std::uint32_t> next_batch(View& view) {
+  std::vector<std::uint32_t> keys;
+  if (auto batch = unifex::sync_wait(*view.begin())) {
+    for (auto& event : batch.value()) {
+      keys.push_back(event);
+    }
+  }
+  return keys;
+}
+
+// a batch holds everything buffered since the previous batch, at most the
+// capacity of the buffer
+void batch_boundaries() {
+  manual_event_source<std::uint32_t> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range(stop, source, overflow_policy::drop_oldest);
+  auto batches = range.batches();
+
+  source.emit(1);
+  source.emit(2);
+  source.emit(3);
+  CHECK(next_batch(batches) == std::vector<std::uint32_t>{1, 2, 3});
+
+  // more than fit in one batch
+  for (std::uint32_t vk = 4; vk <= 9; ++vk) {
+    source.emit(vk);
+  }
+  CHECK(next_batch(batches) == std::vector<std::uint32_t>{6, 7, 8, 9});
+  CHECK(range.dropped_events() == 2);
+
+  // a pending batch completes with the first event that arrives
+  std::thread producer{[&]() {
+    std::this_thread::sleep_for(10ms);
+    source.emit(10);
+  }};
+  CHECK(next_batch(batches) == std::vector<std::uint32_t>{10});
+  producer.join();
+
+  // events buffered when the range stops are not delivered
+  source.emit(11);
+  stop.request_stop();
+  CHECK(next_batch(batches).empty());
+}
+
+// single events and batches may be taken from the same range, one sender
+// at a time
+void batches_and_events() {
+  manual_event_source<std::uint32_t> source;
+  unifex::inplace_stop_source stop;
+  auto range = make_range(stop, source, overflow_policy::block);
+  auto view = range.view();
+  auto batches = range.batches();
+  for (std::uint32_t vk = 1; vk <= 4; ++vk) {
+    source.emit(vk);
+  }
+  CHECK(next_key(view) == 1);
+  CHECK(next_batch(batches) == std::vector<std::uint32_t>{2, 3, 4});
+  source.emit(5);
+  CHECK(next_key(view) == 5);
+  CHECK(range.queued_events() == 5);
+}
+}  // namespace
+
+int main() {
+  overflow(overflow_policy::drop_newest, 1);
+  overflow(overflow_policy::drop_oldest, 3);
+  block();
+  block_after_consumer_gone();
+  stop_races_push();
+  batch_boundaries();
+  batches_and_events();
+  return check_failures != 0;
+}
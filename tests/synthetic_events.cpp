@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unifex/sync_wait.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "key_event.hpp"
+#include "synthetic_events.hpp"
+
+namespace {
+using namespace std::literals::chrono_literals;
+using steady_clock = std::chrono::steady_clock;
+
+struct stamped_event {
+  steady_clock::time_point sent_{};
+  std::size_t producer_{0};
+  std::uint64_t sequence_{0};
+};
+
+stamped_event stamp(std::size_t producer, std::uint64_t sequence) noexcept {
+  return {steady_clock::now(), producer, sequence};
+}
+
+// a schedule without producers or without a pace is rejected by start()
+void invalid_schedules() {
+  CHECK(synthetic_schedule::constant(1000).valid());
+  CHECK(!synthetic_schedule::constant(1000, 0).valid());
+  CHECK(!synthetic_schedule::constant(0).valid());
+  CHECK(!synthetic_schedule::poisson(-1).valid());
+  CHECK(!synthetic_schedule::recorded({}).valid());
+  CHECK(!synthetic_schedule::recorded({{0, 1ms, 1ms}}).valid());
+}
+
+// every producer emits its share of totalEvents, in sequence, and then
+// stops
+void event_count() {
+  constexpr std::uint64_t total = 1001;
+  synthetic_event_source<stamped_event, 64> source{
+      synthetic_schedule::constant(200000, 2, total),
+      &stamp,
+      overflow_policy::block};
+  unifex::sync_wait(source.start());
+  auto view = source.events();
+  std::uint64_t next[2] = {0, 0};
+  for (std::uint64_t i = 0; i < total; ++i) {
+    auto event = unifex::sync_wait(*view.begin());
+    CHECK(!!event);
+    if (!event) {
+      return;
+    }
+    CHECK(event->producer_ < 2);
+    if (event->producer_ < 2) {
+      CHECK(event->sequence_ == next[event->producer_]++);
+    }
+  }
+  CHECK(next[0] == 501);
+  CHECK(next[1] == 500);
+  std::this_thread::sleep_for(20ms);
+  CHECK(source.emitted() == total);
+  CHECK(source.queued_events() == total);
+  CHECK(source.dropped_events() == 0);
+  unifex::sync_wait(source.destroy());
+}
+
+// a recorded schedule emits bursts of events_ spacing_ apart with pause_
+// between them, and no event goes out before its time
+void burst_shape() {
+  constexpr int bursts = 3;
+  constexpr int perBurst = 5;
+  constexpr auto spacing = 1ms;
+  constexpr auto pause = 50ms;
+  synthetic_event_source<stamped_event, 64> source{
+      synthetic_schedule::recorded(
+          {{perBurst, spacing, pause}}, 1, bursts * perBurst),
+      &stamp,
+      overflow_policy::block};
+  unifex::sync_wait(source.start());
+  auto view = source.events();
+  std::vector<steady_clock::time_point> sent;
+  for (int i = 0; i < bursts * perBurst; ++i) {
+    auto event = unifex::sync_wait(*view.begin());
+    CHECK(!!event);
+    if (!event) {
+      return;
+    }
+    sent.push_back(event->sent_);
+  }
+  unifex::sync_wait(source.destroy());
+
+  for (int i = 0; i < bursts * perBurst; ++i) {
+    auto due = (i / perBurst) * ((perBurst - 1) * spacing + pause) +
+        (i % perBurst) * spacing;
+    // the first event may itself be a little late
+    CHECK(sent[i] - sent[0] >= due - 1ms);
+  }
+  for (int b = 0; b < bursts; ++b) {
+    CHECK(sent[b * perBurst + perBurst - 1] - sent[b * perBurst] < pause);
+  }
+}
+
+// the consumer is gone while every producer is blocked on a full buffer.
+// destroy() must still return.
+void destroy_without_consumer() {
+  synthetic_event_source<key_event, 4> source{
+      synthetic_schedule::constant(1000000, 2), overflow_policy::block};
+  unifex::sync_wait(source.start());
+  std::this_thread::sleep_for(20ms);
+  CHECK(source.queued_events() == 4);
+
+  std::atomic<bool> destroyed{false};
+  std::thread destroyer{[&]() {
+    unifex::sync_wait(source.destroy());
+    destroyed = true;
+  }};
+  auto deadline = std::chrono::steady_clock::now() + 2s;
+  while (!destroyed && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  if (!destroyed) {
+    fprintf(stderr, "synthetic_event_source::destroy() did not return\n");
+    std::_Exit(1);
+  }
+  destroyer.join();
+  CHECK(source.queued_events() == 4);
+  // at least the events that were blocked were discarded
+  CHECK(source.dropped_events() >= 1);
+}
+}  // namespace
+
+int main() {
+  invalid_schedules();
+  event_count();
+  burst_shape();
+  destroy_without_consumer();
+  return check_failures != 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include "audio_output.hpp"
+#include "audio_sink.hpp"
+#include "check.hpp"
+#include "mixer.hpp"
+#include "sample_source.hpp"
+
+namespace {
+using namespace std::literals::chrono_literals;
+
+constexpr std::uint32_t sampleRate = 48000;
+
+std::vector<std::uint8_t> read_file(const std::filesystem::path& path) {
+  std::vector<std::uint8_t> bytes;
+  if (FILE* file = fopen(path.string().c_str(), "rb")) {
+    std::uint8_t buffer[4096];
+    while (auto count = fread(buffer, 1, sizeof(buffer), file)) {
+      bytes.insert(bytes.end(), buffer, buffer + count);
+    }
+    fclose(file);
+  }
+  return bytes;
+}
+
+std::uint32_t u32(const std::uint8_t* p) {
+  return std::uint32_t(p[0]) | std::uint32_t(p[1]) << 8 |
+      std::uint32_t(p[2]) << 16 | std::uint32_t(p[3]) << 24;
+}
+std::uint16_t u16(const std::uint8_t* p) {
+  return std::uint16_t(p[0] | p[1] << 8);
+}
+
+// the number of clicks in the samples. a click starts with the first
+// sound after at least 50ms of silence.
+std::size_t count_clicks(const std::int16_t* samples, std::size_t frames) {
+  std::size_t clicks = 0;
+  std::size_t silent = sampleRate;
+  for (std::size_t i = 0; i < frames; ++i) {
+    if (samples[i] == 0) {
+      ++silent;
+      continue;
+    }
+    if (silent >= sampleRate / 20) {
+      ++clicks;
+    }
+    silent = 0;
+  }
+  return clicks;
+}
+}  // namespace
+
+// renders three clicks through the mixer into a wav file, without an audio
+// device, and checks what was written
+int main() {
+  auto path =
+      std::filesystem::temp_directory_path() / "kbrdhook_test_clicks.wav";
+  auto click = synthesize_click(sampleRate);
+  mixer<4> mix;
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    audio_output<mixer<4>, wav_file_sink> output{
+        mix, 512, path.string().c_str(), sampleRate};
+    for (int i = 0; i < 3; ++i) {
+      mix.trigger(click);
+      std::this_thread::sleep_for(150ms);
+    }
+  }
+  auto elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start);
+
+  auto bytes = read_file(path);
+  std::filesystem::remove(path);
+  CHECK(bytes.size() > 44);
+  if (bytes.size() <= 44) {
+    return 1;
+  }
+  auto* header = bytes.data();
+  CHECK(std::memcmp(header, "RIFF", 4) == 0);
+  CHECK(u32(header + 4) == bytes.size() - 8);
+  CHECK(std::memcmp(header + 8, "WAVEfmt ", 8) == 0);
+  CHECK(u16(header + 20) == 1);  // PCM
+  CHECK(u16(header + 22) == 1);  // mono
+  CHECK(u32(header + 24) == sampleRate);
+  CHECK(u16(header + 34) == 16);
+  CHECK(std::memcmp(header + 36, "data", 4) == 0);
+  auto dataBytes = u32(header + 40);
+  CHECK(dataBytes == bytes.size() - 44);
+
+  // the sink is paced at the sample rate
+  auto frames = dataBytes / 2;
+  CHECK(frames > 0.3 * sampleRate);
+  CHECK(frames < elapsed.count() * sampleRate + 4096);
+
+  std::vector<std::int16_t> samples(frames);
+  std::memcpy(samples.data(), header + 44, frames * 2);
+  auto clicks = count_clicks(samples.data(), frames);
+  CHECK(clicks == 3);
+  printf("%u frames in %.3fs, %zu clicks\n", frames, elapsed.count(), clicks);
+  return check_failures != 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) Kirk Shoop.
+ *
+ * Licensed under the Apache License Version 2.0 with LLVM Exceptions
+ * (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ *
+ *   https://llvm.org/LICENSE.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unifex/sync_wait.hpp>
+#include <unifex/then.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "work_stealing_pool.hpp"
+
+namespace {
+using namespace std::literals::chrono_literals;
+
+// records the thread it ran on
+struct recording_task : work_stealing_pool::task {
+  std::atomic<std::size_t>* done_;
+  std::thread::id ranOn_{};
+
+  explicit recording_task(std::atomic<std::size_t>* done)
+    : task{&_execute}
+    , done_(done) {}
+
+  static void _execute(work_stealing_pool::task* t) noexcept {
+    auto& self = *static_cast<recording_task*>(t);
+    self.ranOn_ = std::this_thread::get_id();
+    std::this_thread::sleep_for(100us);
+    self.done_->fetch_add(1);
+  }
+};
+
+// work submitted from a worker goes to that worker's deque. while the
+// worker is busy, the other workers must steal all of it.
+void idle_workers_steal() {
+  constexpr std::size_t count = 200;
+  work_stealing_pool pool{4};
+  std::atomic<std::size_t> done{0};
+  std::vector<recording_task> tasks(count, recording_task{&done});
+
+  struct root_task : work_stealing_pool::task {
+    work_stealing_pool* pool_;
+    std::vector<recording_task>* tasks_;
+    std::atomic<std::size_t>* done_;
+    std::thread::id ranOn_{};
+    std::atomic<bool> finished_{false};
+
+    static void _execute(work_stealing_pool::task* t) noexcept {
+      auto& self = *static_cast<root_task*>(t);
+      self.ranOn_ = std::this_thread::get_id();
+      for (auto& task : *self.tasks_) {
+        self.pool_->submit(&task);
+      }
+      // stay busy until the others have run everything (or give up)
+      auto deadline = std::chrono::steady_clock::now() + 5s;
+      while (*self.done_ != self.tasks_->size() &&
+             std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+      }
+      self.finished_ = true;
+    }
+  } root{{&root_task::_execute}, &pool, &tasks, &done};
+  pool.submit(&root);
+
+  while (!root.finished_) {
+    std::this_thread::sleep_for(1ms);
+  }
+  CHECK(done == count);
+  std::set<std::thread::id> thieves;
+  for (auto& task : tasks) {
+    CHECK(task.ranOn_ != root.ranOn_);
+    thieves.insert(task.ranOn_);
+  }
+  CHECK(thieves.size() > 1);
+}
+
+// the destructor runs everything that was queued before it joins
+void shutdown_runs_queued_work() {
+  constexpr std::size_t count = 1000;
+  std::atomic<std::size_t> done{0};
+  std::vector<recording_task> tasks(count, recording_task{&done});
+  {
+    work_stealing_pool pool{3};
+    for (auto& task : tasks) {
+      pool.submit(&task);
+    }
+  }
+  CHECK(done == count);
+}
+
+// an idle pool shuts down promptly
+void shutdown_when_idle() {
+  auto start = std::chrono::steady_clock::now();
+  { work_stealing_pool pool{8}; }
+  CHECK(std::chrono::steady_clock::now() - start < 1s);
+}
+
+// the senders from the scheduler complete on a worker
+void scheduler_runs_on_pool() {
+  work_stealing_pool pool{2};
+  auto ranOn = unifex::sync_wait(unifex::then(
+      pool.get_scheduler().schedule(),
+      []() { return std::this_thread::get_id(); }));
+  CHECK(!!ranOn);
+  CHECK(ranOn != std::this_thread::get_id());
+}
+}  // namespace
+
+int main() {
+  idle_workers_steal();
+  shutdown_runs_queued_work();
+  shutdown_when_idle();
+  scheduler_runs_on_pool();
+  return check_failures != 0;
+}